@@ -0,0 +1,339 @@
+"""
+benchmark.py
+====================================
+A reproducible benchmark of the stages of the payment loop.
+
+    python benchmarks/benchmark.py listchannels20220412.json --sizes small mid full
+
+On the first run a `Snapshot` is derived from the listchannels dump for every size (the channels among
+the best connected nodes for `small` and `mid`, all channels for `full`) with seeded oracle liquidity.
+The snapshots are cached in `--snapshot-dir` so later runs measure exactly the same graphs. The payment
+pairs are drawn with the same seed among the pairs that can pay the largest amount and every pair is
+paid with every amount after all learnt information has been forgotten and the oracle has been reset.
+
+For every stage the wall time and the peak of the memory that was traced while the stage ran are
+reported. Tracing the memory slows python down, use `--no-memory` for timings without that overhead.
+
+With `--channel-math` the batch kernels of `ChannelMath` (entropy, scoring of attempts and probing of
+onions) are additionally timed on every snapshot against the scalar methods of `UncertaintyChannel`, once
+with the numpy fallback and once with the compiled `_channel_math` extension if it is built.
+
+With `--warm-start` the payment matrix is paid a second time with the `IncrementalMinCostFlow` that warm
+starts every round from the flow of the previous one, and the solver stages of both runs are compared.
+"""
+
+import argparse
+import json
+import os
+import random
+import sys
+import time
+import tracemalloc
+from contextlib import contextmanager
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.ChannelGraph import ChannelGraph
+from pickhardtpayments.UncertaintyNetwork import UncertaintyNetwork
+from pickhardtpayments.OracleLightningNetwork import OracleLightningNetwork, DEFAULT_BASE_THRESHOLD
+from pickhardtpayments.SyncSimulatedPaymentSession import SyncSimulatedPaymentSession
+from pickhardtpayments.Snapshot import Snapshot, save_snapshot
+from pickhardtpayments import ChannelMath
+from pickhardtpayments.Metrics import InMemoryMetrics, SOLVER_BUILD_SECONDS, SOLVER_SOLVE_SECONDS, \
+    DECOMPOSITION_SECONDS, ONION_ROUND_TRIP_SECONDS
+
+# number of best connected nodes of every size (None for the whole graph)
+SIZES = {"small": 500, "mid": 3000, "full": None}
+DEFAULT_AMOUNTS = (10_000, 100_000, 1_000_000)
+DEFAULT_PAIRS = 5
+DEFAULT_SEED = 42
+# how many pairs are drawn per requested pair to find pairs that can pay the largest amount
+MAX_DRAWS = 20
+# number of paths and their length on which the channel math kernels are timed
+KERNEL_PATHS = 10_000
+KERNEL_PATH_LENGTH = 5
+KERNEL_AMOUNT = 100_000
+
+GRAPH_LOAD_SECONDS = "graph_load_seconds"
+NETWORK_CONSTRUCTION_SECONDS = "network_construction_seconds"
+STAGES = (GRAPH_LOAD_SECONDS, NETWORK_CONSTRUCTION_SECONDS, SOLVER_BUILD_SECONDS, SOLVER_SOLVE_SECONDS,
+          DECOMPOSITION_SECONDS, ONION_ROUND_TRIP_SECONDS)
+
+
+class StageMetrics(InMemoryMetrics):
+    """
+    keeps every observed duration and the peak of the traced memory of every timed stage
+    """
+
+    def __init__(self):
+        super().__init__()
+        self._samples = {}
+        self._peaks = {}
+
+    def observe(self, name: str, value: float):
+        super().observe(name, value)
+        self._samples.setdefault(name, []).append(value)
+
+    @contextmanager
+    def timer(self, name: str):
+        tracing = tracemalloc.is_tracing()
+        if tracing:
+            current, _ = tracemalloc.get_traced_memory()
+            tracemalloc.reset_peak()
+        with super().timer(name):
+            yield
+        if tracing:
+            _, peak = tracemalloc.get_traced_memory()
+            self._peaks[name] = max(self._peaks.get(name, 0), peak - current)
+
+    def stage(self, name: str):
+        """
+        returns count, total, mean and maximal duration in seconds and the peak memory in bytes of a stage
+        """
+        samples = self._samples.get(name, [])
+        total = sum(samples)
+        return {"count": len(samples), "total": total, "mean": total / len(samples) if samples else 0.,
+                "max": max(samples) if samples else 0., "peak_memory": self._peaks.get(name)}
+
+
+def make_snapshot(channels_file: str, size: str, seed: int, filename: str):
+    """
+    derives the graph of `size` from the listchannels dump and stores it with seeded oracle liquidity
+    """
+    channel_graph = ChannelGraph(channels_file)
+    number_of_nodes = SIZES[size]
+    if number_of_nodes is not None:
+        network = channel_graph.network
+        nodes = set(sorted(network.nodes(), key=lambda node: (-network.degree(node), node))[:number_of_nodes])
+        channel_graph = ChannelGraph.from_channels([channel for src, dest, channel in network.edges(data="channel")
+                                                    if src in nodes and dest in nodes])
+    # OracleChannel draws the actual liquidity from the global random generator
+    random.seed(seed)
+    save_snapshot(filename, UncertaintyNetwork(channel_graph), OracleLightningNetwork(channel_graph))
+
+
+def payment_pairs(uncertainty_network: UncertaintyNetwork, oracle: OracleLightningNetwork, count: int, amt: int,
+                  seed: int):
+    """
+    draws up to `count` pairs of distinct nodes between which the oracle can deliver `amt`
+    """
+    topology = uncertainty_network.topology
+
+    def without_base_fee(rows):
+        return len(rows) > 0 and int(topology.base_fee[rows].min()) <= DEFAULT_BASE_THRESHOLD
+
+    # the max flow of the oracle only knows nodes with channels up to the base fee threshold
+    nodes = sorted(node for node in topology.node_ids
+                   if without_base_fee(topology.out_rows(node)) and without_base_fee(topology.in_rows(node)))
+    rng = random.Random(seed)
+    pairs = []
+    for _ in range(MAX_DRAWS * count):
+        if len(nodes) < 2 or len(pairs) == count:
+            break
+        src, dest = rng.sample(nodes, 2)
+        if oracle.theoretical_maximum_payable_amount(src, dest) >= amt:
+            pairs.append((src, dest))
+    return pairs
+
+
+def run(snapshot_file: str, amounts, number_of_pairs: int, seed: int, mu: int = 1, warm_start: bool = False):
+    """
+    runs the payment matrix on a snapshot and returns the `StageMetrics` and the number of successful
+    and of all payments
+    """
+    metrics = StageMetrics()
+    with metrics.timer(GRAPH_LOAD_SECONDS):
+        snapshot = Snapshot(snapshot_file)
+        channel_graph = snapshot.channel_graph()
+    with metrics.timer(NETWORK_CONSTRUCTION_SECONDS):
+        uncertainty_network = snapshot.uncertainty_network(channel_graph)
+        oracle = snapshot.oracle_lightning_network(channel_graph)
+
+    liquidity = [(channel, channel.actual_liquidity) for channel in oracle.channels]
+    session = SyncSimulatedPaymentSession(oracle, uncertainty_network, prune_network=False, metrics=metrics,
+                                          quiet=True, warm_start=warm_start)
+    successful = 0
+    payments = 0
+    for src, dest in payment_pairs(uncertainty_network, oracle, number_of_pairs, max(amounts), seed):
+        for amt in amounts:
+            uncertainty_network.reset_uncertainty_network()
+            for channel, actual_liquidity in liquidity:
+                channel.actual_liquidity = actual_liquidity
+            payment = session.pickhardt_pay(src, dest, amt, mu)
+            payments += 1
+            if payment.successful:
+                successful += 1
+    return metrics, successful, payments
+
+
+def random_paths(uncertainty_network: UncertaintyNetwork, count: int, length: int, seed: int):
+    """
+    draws `count` random walks of up to `length` channels (as rows of the channel table)
+    """
+    topology = uncertainty_network.topology
+    channel_table = uncertainty_network.channel_table
+    rng = random.Random(seed)
+    node_ids = topology.node_ids
+    paths = []
+    while len(paths) < count:
+        node = rng.choice(node_ids)
+        path = []
+        for _ in range(length):
+            rows = topology.out_rows(node)
+            if len(rows) == 0:
+                break
+            row = int(rows[rng.randrange(len(rows))])
+            path.append(row)
+            node = channel_table.node_ids[channel_table.dest[row]]
+        if path:
+            paths.append(path)
+    return paths
+
+
+def scalar_probe(oracle: OracleLightningNetwork, path, amt: int):
+    """
+    the hop by hop probing of `OracleLightningNetwork.send_onion` via the scalar methods of the channels
+    """
+    for channel in path:
+        oracle_channel = oracle.get_channel_by_id(channel.short_channel_id, channel.direction)
+        success_of_probe = oracle_channel.can_forward(channel.in_flight + amt)
+        channel.update_knowledge(amt, success_of_probe)
+        if not success_of_probe:
+            return False
+    return True
+
+
+def time_channel_math(snapshot_file: str, seed: int):
+    """
+    times entropy, scoring and probing with the scalar methods and with every available backend of
+    `ChannelMath` and returns the seconds per kernel and backend
+    """
+    snapshot = Snapshot(snapshot_file)
+    channel_graph = snapshot.channel_graph()
+    uncertainty_network = snapshot.uncertainty_network(channel_graph)
+    oracle = snapshot.oracle_lightning_network(channel_graph)
+    channel_table = uncertainty_network.channel_table
+    channels = uncertainty_network.channels
+    paths = random_paths(uncertainty_network, KERNEL_PATHS, KERNEL_PATH_LENGTH, seed)
+    channel_paths = [[channels[row] for row in path] for path in paths]
+
+    def stopwatch(function):
+        uncertainty_network.reset_uncertainty_network()
+        start = time.perf_counter()
+        function()
+        return time.perf_counter() - start
+
+    def scalar_score():
+        for path in channel_paths:
+            for channel in path:
+                channel.routing_cost_msat(KERNEL_AMOUNT)
+                channel.success_probability(KERNEL_AMOUNT)
+
+    def batch_score():
+        for path in paths:
+            channel_table.score_path(path, KERNEL_AMOUNT)
+
+    timings = {
+        "entropy": {"scalar": stopwatch(lambda: sum(channel.entropy() for channel in channels))},
+        "score attempts": {"scalar": stopwatch(scalar_score)},
+        "probe onions": {"scalar": stopwatch(lambda: [scalar_probe(oracle, path, KERNEL_AMOUNT)
+                                                      for path in channel_paths])},
+    }
+    backends = [("numpy", False)] + ([("native", True)] if ChannelMath.NATIVE_AVAILABLE else [])
+    native = ChannelMath.native_enabled()
+    try:
+        for backend, enabled in backends:
+            ChannelMath.use_native(enabled)
+            timings["entropy"][backend] = stopwatch(channel_table.entropy)
+            timings["score attempts"][backend] = stopwatch(batch_score)
+            timings["probe onions"][backend] = stopwatch(lambda: [oracle.send_onion(path, KERNEL_AMOUNT)
+                                                                  for path in channel_paths])
+    finally:
+        ChannelMath.use_native(native)
+    uncertainty_network.reset_uncertainty_network()
+    return timings
+
+
+def report_channel_math(timings):
+    backends = [backend for backend in ("scalar", "numpy", "native") if backend in timings["entropy"]]
+    print("\n{:30}".format("channel math kernel") + "".join("{:>10}".format(backend + " ms") for backend in backends)
+          + "{:>10}".format("speedup"))
+    for kernel, timing in timings.items():
+        print("{:30}".format(kernel) + "".join("{:10.3f}".format(timing[backend] * 1000) for backend in backends)
+              + "{:9.1f}x".format(timing["scalar"] / max(timing[backends[-1]], 1e-9)))
+
+
+def report_warm_start(cold: StageMetrics, warm: StageMetrics):
+    print("\n{:30} {:>10} {:>10} {:>10}".format("solver stage", "cold s", "warm s", "speedup"))
+    for name in (SOLVER_BUILD_SECONDS, SOLVER_SOLVE_SECONDS):
+        cold_total, warm_total = cold.stage(name)["total"], warm.stage(name)["total"]
+        print("{:30} {:10.3f} {:10.3f} {:9.1f}x".format(name, cold_total, warm_total,
+                                                       cold_total / max(warm_total, 1e-9)))
+
+
+def report(size: str, metrics: StageMetrics, successful: int, payments: int, runtime: float):
+    print("\n{} ({} of {} payments successful, {:.2f} sec)".format(size, successful, payments, runtime))
+    print("{:30} {:>6} {:>10} {:>10} {:>10} {:>10}".format("stage", "count", "total s", "mean ms", "max ms",
+                                                            "peak MiB"))
+    for name in STAGES:
+        stage = metrics.stage(name)
+        peak = "-" if stage["peak_memory"] is None else "{:.2f}".format(stage["peak_memory"] / 2 ** 20)
+        print("{:30} {:6} {:10.3f} {:10.3f} {:10.3f} {:>10}".format(name, stage["count"], stage["total"],
+                                                                  stage["mean"] * 1000, stage["max"] * 1000, peak))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="benchmark of the stages of the payment loop")
+    parser.add_argument("channels", help="listchannels json dump of core lightning the snapshots are derived from")
+    parser.add_argument("--sizes", nargs="+", choices=list(SIZES), default=["small", "mid"])
+    parser.add_argument("--seed", type=int, default=DEFAULT_SEED)
+    parser.add_argument("--pairs", type=int, default=DEFAULT_PAIRS)
+    parser.add_argument("--amounts", type=int, nargs="+", default=list(DEFAULT_AMOUNTS))
+    parser.add_argument("--mu", type=int, default=1)
+    parser.add_argument("--snapshot-dir", default=os.path.join(ROOT, "benchmarks", "snapshots"))
+    parser.add_argument("--no-memory", action="store_true", help="do not trace the peak memory of the stages")
+    parser.add_argument("--channel-math", action="store_true",
+                        help="also times the batch kernels of ChannelMath against the scalar channel methods")
+    parser.add_argument("--warm-start", action="store_true",
+                        help="also pays the matrix with warm started solves and compares the solver stages")
+    parser.add_argument("--json", help="writes the results to this file")
+    args = parser.parse_args()
+
+    os.makedirs(args.snapshot_dir, exist_ok=True)
+    results = {}
+    for size in args.sizes:
+        snapshot_file = os.path.join(args.snapshot_dir, "{}-{}.snapshot".format(size, args.seed))
+        if not os.path.exists(snapshot_file):
+            print("creating snapshot {}".format(snapshot_file))
+            make_snapshot(args.channels, size, args.seed, snapshot_file)
+
+        if not args.no_memory:
+            tracemalloc.start()
+        start = time.time()
+        metrics, successful, payments = run(snapshot_file, args.amounts, args.pairs, args.seed, args.mu)
+        runtime = time.time() - start
+        if not args.no_memory:
+            tracemalloc.stop()
+        report(size, metrics, successful, payments, runtime)
+        results[size] = {"successful": successful, "payments": payments, "runtime": runtime,
+                         "stages": {name: metrics.stage(name) for name in STAGES}}
+        if args.warm_start:
+            warm_metrics, warm_successful, _ = run(snapshot_file, args.amounts, args.pairs, args.seed, args.mu,
+                                                   warm_start=True)
+            report_warm_start(metrics, warm_metrics)
+            results[size]["warm_start"] = {"successful": warm_successful,
+                                           "stages": {name: warm_metrics.stage(name) for name in STAGES}}
+        if args.channel_math:
+            timings = time_channel_math(snapshot_file, args.seed)
+            report_channel_math(timings)
+            results[size]["channel_math"] = timings
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"seed": args.seed, "pairs": args.pairs, "amounts": args.amounts, "mu": args.mu,
+                       "results": results}, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()
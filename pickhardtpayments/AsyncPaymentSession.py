@@ -0,0 +1,184 @@
+"""
+AsyncPaymentSession.py
+====================================
+A payment session that sends out all onions of a round concurrently.
+"""
+
+import asyncio
+import logging
+import time
+from typing import Callable, List
+
+from .Attempt import Attempt, AttemptStatus
+from .Payment import Payment
+from .UncertaintyNetwork import UncertaintyNetwork
+from .OracleLightningNetwork import OracleLightningNetwork
+from .FlowDecomposition import DecompositionPolicy
+from .Metrics import ONION_ROUND_TRIP_SECONDS, FAILED_ATTEMPTS_TOTAL
+from .SyncSimulatedPaymentSession import SyncSimulatedPaymentSession, set_logger
+
+DEFAULT_BASE_THRESHOLD = 0
+DEFAULT_REPLAN_FRACTION = 0.5
+MAX_ROUNDS = 10
+
+
+class OracleBackend:
+    """
+    Sends onions against a simulated `OracleLightningNetwork`.
+
+    Any other backend, e.g. an adapter to a real lightning node, has to offer the same two coroutines.
+    `send_onion` returns a tuple consisting of the success flag and the erring channel and has to update
+    our knowledge about the channels of the path via `UncertaintyChannel.update_knowledge` as the oracle does.
+    `settle_attempts` settles all arrived attempts of a payment at once and raises an exception (leaving
+    every channel untouched) if one of them cannot settle.
+
+    `latency` is an optional function that returns the simulated round trip time of an onion along a path
+    in seconds.
+    """
+
+    def __init__(self, oracle: OracleLightningNetwork, latency: Callable = None):
+        self._oracle = oracle
+        self._latency = latency
+
+    async def send_onion(self, path, amt: int):
+        if self._latency is not None:
+            await asyncio.sleep(self._latency(path))
+        return self._oracle.send_onion(path, amt)
+
+    async def settle_attempts(self, attempts):
+        return self._oracle.settle_attempts(attempts)
+
+
+class AsyncPaymentSession(SyncSimulatedPaymentSession):
+    """
+    A payment session that launches all onions of a round concurrently against a pluggable backend.
+
+    The results of the onions are applied to the UncertaintyNetwork as soon as they arrive. The next round
+    for the residual amount is planned without waiting for the slowest HTLC as soon as the failed amount
+    since the last planning reaches `replan_fraction` of the amount planned in that round (or when no onion
+    is outstanding anymore). Onions that are still in flight keep their amount allocated to the channels
+    of their path, so the next round is planned around them.
+
+    Since everything runs on a single asyncio event loop, updates of our belief never race with each other.
+    """
+
+    def __init__(self,
+                 oracle: OracleLightningNetwork,
+                 uncertainty_network: UncertaintyNetwork,
+                 prune_network: bool = True,
+                 decomposition_policy: DecompositionPolicy = DecompositionPolicy.SHORTEST,
+                 backend=None,
+                 replan_fraction: float = DEFAULT_REPLAN_FRACTION,
+                 **kwargs):
+        """
+        all further keyword arguments (e.g. `warm_start`, `pruning`, `metrics` or `quiet`) configure the
+        planning as in `SyncSimulatedPaymentSession`
+        """
+        super().__init__(oracle, uncertainty_network, prune_network, decomposition_policy, **kwargs)
+        self._backend = backend if backend is not None else OracleBackend(oracle)
+        self._replan_fraction = replan_fraction
+
+    def _launch_attempts(self, attempts: List[Attempt], in_flight: dict):
+        """
+        sends out all onions of a round concurrently and remembers which task belongs to which attempt
+        """
+        for attempt in attempts:
+            task = asyncio.ensure_future(self._send_onion(attempt))
+            in_flight[task] = attempt
+
+    async def _send_onion(self, attempt: Attempt):
+        with self._metrics.timer(ONION_ROUND_TRIP_SECONDS):
+            return await self._backend.send_onion(attempt.path, attempt.amount)
+
+    def _apply_result(self, task, attempt: Attempt):
+        """
+        updates the status of the attempt and the allocated amounts once its onion returned
+
+        returns the amount that failed to be delivered
+        """
+        try:
+            success, erring_channel = task.result()
+        except Exception as e:
+            if not self._quiet:
+                logging.warning("onion could not be sent: %s", e)
+            success = False
+        if success:
+            attempt.status = AttemptStatus.ARRIVED
+            # handling amounts on path happens in Attempt Class.
+            self._uncertainty_network.allocate_amount_on_path(attempt.path, attempt.amount)
+            return 0
+        attempt.status = AttemptStatus.FAILED
+        self._metrics.increment(FAILED_ATTEMPTS_TOTAL)
+        return attempt.amount
+
+    async def _settle_payment_async(self, payment: Payment, residual: int):
+        """
+        settles all arrived onions atomically through the backend if the `residual` amount is zero, like
+        `_settle_payment` does with the oracle
+        """
+        if residual == 0:
+            arrived = list(payment.filter_attempts(AttemptStatus.ARRIVED))
+            try:
+                await self._backend.settle_attempts(arrived)
+            except Exception as e:
+                if not self._quiet:
+                    logging.warning(e)
+            else:
+                for onion in arrived:
+                    onion.status = AttemptStatus.SETTLED
+                payment.successful = True
+        payment.end_time = time.time()
+
+    async def pickhardt_pay_async(self, src, dest, amt, mu=1, base=DEFAULT_BASE_THRESHOLD):
+        """
+        conduct one payment with concurrently sent onions. Has the same contract as `pickhardt_pay`
+        """
+        if not self._quiet:
+            set_logger()
+            logging.info('*** new pickhardt payment ***')
+
+        entropy_start = self._uncertainty_network.entropy()
+        payment = Payment(src, dest, amt)
+
+        # residual is the amount that has neither arrived nor is in flight
+        residual = amt
+        in_flight = {}
+        cnt = 0
+        planned_amount = 0
+        failed_since_planning = 0
+        while residual > 0 or in_flight:
+            replan = residual > 0 and cnt < MAX_ROUNDS and (
+                not in_flight or failed_since_planning >= self._replan_fraction * planned_amount)
+            if replan:
+                if not self._quiet:
+                    logging.info("round number %d: try to deliver %d satoshi with %d onions in flight", cnt + 1,
+                                 residual, len(in_flight))
+                attempts, runtime = self._generate_candidate_paths(src, dest, residual, mu, base)
+                if not self._quiet:
+                    logging.info("runtime of flow computation: %4.2f sec", runtime)
+                payment.add_attempts(attempts)
+                self._record_round(attempts)
+                self._launch_attempts(attempts, in_flight)
+                planned_amount = sum(attempt.amount for attempt in attempts)
+                residual -= planned_amount
+                failed_since_planning = 0
+                cnt += 1
+
+            if not in_flight:
+                break
+            done, _ = await asyncio.wait(list(in_flight.keys()), return_when=asyncio.FIRST_COMPLETED)
+            for task in done:
+                failed_amount = self._apply_result(task, in_flight.pop(task))
+                residual += failed_amount
+                failed_since_planning += failed_amount
+
+        # When residual amount is 0 / enough successful onions have been found, then settle payment. Else drop onions.
+        await self._settle_payment_async(payment, residual)
+        return self._conclude_payment(payment, cnt, entropy_start, mu)
+
+    def pickhardt_pay(self, src, dest, amt, mu=1, base=DEFAULT_BASE_THRESHOLD):
+        """
+        conduct one experiment with concurrently sent onions. Use `pickhardt_pay_async` from within a running
+        event loop
+        """
+        return asyncio.run(self.pickhardt_pay_async(src, dest, amt, mu, base))
@@ -2,6 +2,7 @@ from enum import Enum
 
 from Channel import Channel
 from pickhardtpayments import UncertaintyChannel
+from .ChannelTable import path_rows
 
 from typing import List
 
@@ -51,6 +52,12 @@ class Attempt:
         channel: UncertaintyChannel
         self._routing_fee = 0
         self._probability = 1
+        # channels that are views on one ChannelTable are scored and allocated in one batch
+        channel_table, rows = path_rows(path)
+        if channel_table is not None:
+            self._routing_fee, self._probability = channel_table.score_path(rows, amount)
+            channel_table.allocate_amount(rows, amount)
+            path = []
         for channel in path:
             self._routing_fee += channel.routing_cost_msat(amount)
             self._probability *= channel.success_probability(amount)
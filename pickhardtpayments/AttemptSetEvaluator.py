@@ -0,0 +1,140 @@
+from typing import List
+
+import numpy as np
+
+from .Attempt import Attempt, AttemptStatus
+from .ChannelTable import ChannelTable, uniform_success_probability
+
+
+class AttemptSetStatistics:
+    """
+    The joint features of a set of attempts as computed by the `AttemptSetEvaluator`.
+
+    `probability` is the probability that all attempts arrive, `attempt_probabilities` the probability of
+    every single attempt (in the order of the set), `expected_amount` the sum of the amounts weighted with
+    these probabilities and `routing_fee` the routing fee in msat of all attempts (without downstream fees).
+
+    The probability of an attempt assumes that all attempts before it in the set locked their amounts on
+    the shared channels first (see `AttemptSetEvaluator`). The `expected_amount` is only the expected number
+    of sats that arrive under this assumption, if onions race each other it is an estimate.
+    """
+
+    def __init__(self, probability: float, attempt_probabilities, expected_amount: float, routing_fee: int):
+        self._probability = probability
+        self._attempt_probabilities = attempt_probabilities
+        self._expected_amount = expected_amount
+        self._routing_fee = routing_fee
+
+    def __str__(self):
+        return "{} attempts arrive with a probability of {:6.2f}%, expected to deliver {:.0f} sats for a fee of " \
+               "{:8.3f} sat".format(len(self._attempt_probabilities), self._probability * 100,
+                                     self._expected_amount, self._routing_fee / 1000)
+
+    @property
+    def probability(self) -> float:
+        return self._probability
+
+    @property
+    def attempt_probabilities(self):
+        return self._attempt_probabilities
+
+    @property
+    def expected_amount(self) -> float:
+        return self._expected_amount
+
+    @property
+    def routing_fee(self) -> int:
+        return self._routing_fee
+
+
+class AttemptSetEvaluator:
+    """
+    Computes the joint success probability of a set of paths over the channels they share.
+
+    The liquidity of every channel is uniformly distributed according to our belief in the `ChannelTable`
+    and independent of the other channels. The attempts of a set lock their amounts in the given order, so
+    the i-th attempt succeeds on a channel if its liquidity covers the in_flight amount of the channel and
+    the amounts of all attempts up to and including the i-th one that use the channel. As these events are
+    nested per channel, all attempts arrive if and only if every channel holds the total amount of the set
+    and the joint probability is the product over the distinct channels instead of the product over attempts
+    that treats shared channels as independent. The joint probability does not depend on the order, the
+    probabilities of the single attempts and thus the expected amount do.
+
+    This is what `Attempt` approximates by allocating its amount as in_flight while the attempts are
+    planned. The evaluator only reads the table (the decay of the belief is computed but not stored), so
+    it can score many alternative decompositions, also from several threads, without touching the in_flight
+    allocations.
+    """
+
+    def __init__(self, channel_table: ChannelTable):
+        self._channel_table = channel_table
+
+    def evaluate_paths(self, paths, amounts, allocated=None, now: float = None) -> AttemptSetStatistics:
+        """
+        evaluates paths given as sequences of rows of the channel table and the amount of every path
+
+        `allocated` optionally flags the paths whose amount is already part of the in_flight amount of the
+        table (e.g. planned `Attempts`). Their amounts are left out of the in_flight amount, so they are not
+        counted twice.
+        """
+        table = self._channel_table
+        amounts = np.asarray(amounts, dtype=np.int64)
+        lengths = np.array([len(path) for path in paths], dtype=np.int64)
+        offsets = np.zeros(len(lengths) + 1, dtype=np.int64)
+        offsets[1:] = np.cumsum(lengths)
+        if offsets[-1] == 0:
+            return AttemptSetStatistics(1., np.ones(len(lengths)), float(amounts.sum()), 0)
+
+        rows = np.concatenate([np.asarray(path, dtype=np.int64) for path in paths])
+        entry_amounts = np.repeat(amounts, lengths)
+
+        # the stable sort keeps the entries of a channel in the order of the attempts, so the cumulative sum
+        # within a channel is the amount that is locked in it once the attempt of the entry passed it
+        order = np.argsort(rows, kind="stable")
+        sorted_rows = rows[order]
+        first = np.ones(len(sorted_rows), dtype=bool)
+        first[1:] = sorted_rows[1:] != sorted_rows[:-1]
+        group_starts = np.flatnonzero(first)
+        group_sizes = np.diff(np.concatenate([group_starts, np.array([len(sorted_rows)], dtype=np.int64)]))
+        group_ends = group_starts + group_sizes - 1
+
+        def cumulative_per_channel(values):
+            cumulative = np.cumsum(values)
+            return cumulative - np.repeat(cumulative[group_starts] - values[group_starts], group_sizes)
+
+        locked_sorted = cumulative_per_channel(entry_amounts[order])
+        base_sorted = table.in_flight[sorted_rows]
+        if allocated is not None:
+            allocated_amounts = np.repeat(np.where(np.asarray(allocated, dtype=bool), amounts, 0), lengths)
+            base_sorted = base_sorted - np.repeat(cumulative_per_channel(allocated_amounts[order])[group_ends],
+                                                  group_sizes)
+        tested_sorted = base_sorted + locked_sorted
+
+        # all attempts arrive if and only if every distinct channel holds the total amount that is locked in it
+        distinct_rows = sorted_rows[group_starts]
+        min_liquidity, max_liquidity = table.belief(distinct_rows, now)
+        probability = float(np.prod(uniform_success_probability(min_liquidity, max_liquidity,
+                                                                 tested_sorted[group_ends])))
+
+        min_liquidity, max_liquidity = table.belief(sorted_rows, now)
+        entry_probabilities = np.zeros(len(rows))
+        entry_probabilities[order] = uniform_success_probability(min_liquidity, max_liquidity, tested_sorted)
+        attempt_probabilities = np.ones(len(lengths))
+        for attempt, (start, end) in enumerate(zip(offsets[:-1].tolist(), offsets[1:].tolist())):
+            if end > start:
+                attempt_probabilities[attempt] = float(np.prod(entry_probabilities[start:end]))
+
+        routing_fee = int(((table.ppm[rows] * entry_amounts / 1000).astype(np.int64) + table.base_fee[rows]).sum())
+        expected_amount = float((attempt_probabilities * amounts).sum())
+        return AttemptSetStatistics(probability, attempt_probabilities, expected_amount, routing_fee)
+
+    def evaluate(self, attempts: List[Attempt], now: float = None) -> AttemptSetStatistics:
+        """
+        evaluates a set of `Attempts` whose channels are views on the channel table
+
+        Planned attempts have allocated their amount as in_flight when they were created (see `Attempt`),
+        which is taken into account.
+        """
+        return self.evaluate_paths([[channel.row for channel in attempt.path] for attempt in attempts],
+                                   [attempt.amount for attempt in attempts],
+                                   [attempt.status == AttemptStatus.PLANNED for attempt in attempts], now)
@@ -86,5 +86,12 @@ class Channel:
     def short_channel_id(self):
         return self._cln_jsn[ChannelFields.SHORT_CHANNEL_ID]
 
+    @property
+    def direction(self):
+        """
+        the direction of the channel as used in the gossip protocol (0 if the source has the smaller node id)
+        """
+        return 0 if self.src < self.dest else 1
+
     def __str__(self):
         return str(self._cln_jsn)
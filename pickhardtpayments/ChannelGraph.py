@@ -1,6 +1,24 @@
 import networkx as nx
 import json
-from .Channel import Channel
+import sys
+from .Channel import Channel, ChannelFields
+from .Topology import Topology
+from .Gossip import GossipEventType
+
+# bytes read at once from a listchannels dump.
+READ_CHUNK_SIZE = 1 << 20
+
+# characters of a single channel record (a few hundred in practice) beyond which the dump is rejected.
+MAX_RECORD_SIZE = 1 << 16
+
+# a decoding error further than this from the end of the buffer is not caused by a truncated token.
+MAX_TOKEN_SIZE = 64
+
+# values of `ChannelFields` which are the only data that we keep of a channel
+CHANNEL_FIELDS = tuple(value for key, value in vars(ChannelFields).items() if not key.startswith("_"))
+
+# node ids and short channel ids repeat a lot and are stored only once
+INTERNED_FIELDS = (ChannelFields.SRC, ChannelFields.DEST, ChannelFields.SHORT_CHANNEL_ID)
 
 
 class ChannelGraph:
@@ -11,14 +29,72 @@ class ChannelGraph:
     The channels of the Channel Graph are directed and identified uniquely by a triple consisting of
     (source_node_id, destination_node_id, short_channel_id). This allows the ChannelGraph to also 
     contain parallel channels.
+
+    Next to the graph a flat index maps `(short_channel_id, direction)` to every channel, so looking up
+    a channel (or pairing the views of the same channel in two networks) does not walk the adjacency of
+    the graph.
+
+    The `topology` of the graph is built once on first use. The `UncertaintyNetwork` and the
+    `OracleLightningNetwork` are overlays on it instead of copies of the graph.
     """
 
     def _get_channel_json(self, filename: str):
         """
-        extracts the dictionary from the file that contains lightning-cli listchannels json string
+        yields the channels of the file that contains lightning-cli listchannels json string one by one
+
+        The file is parsed incrementally in chunks of `READ_CHUNK_SIZE`, so the dump (often several hundred MB)
+        is never held in memory as a whole. A malformed channel or one of more than `MAX_RECORD_SIZE` characters
+        raises instead of buffering the rest of the file. Of every channel only the fields listed in
+        `ChannelFields` are kept and the strings that identify nodes and channels are interned.
         """
-        f = open(filename)
-        return json.load(f)["channels"]
+        decoder = json.JSONDecoder()
+        with open(filename) as f:
+            buffer = ""
+            # characters of the file before the buffer
+            offset = 0
+            eof = False
+            pos = -1
+            # skip everything up to the opening bracket of the channels array
+            while pos < 0:
+                chunk = f.read(READ_CHUNK_SIZE)
+                if not chunk:
+                    raise ValueError("{} does not contain a list of channels".format(filename))
+                buffer += chunk
+                key = buffer.find('"channels"')
+                if key >= 0:
+                    pos = buffer.find("[", key)
+            pos += 1
+
+            while True:
+                while pos < len(buffer) and buffer[pos] in " \t\r\n,":
+                    pos += 1
+                if pos < len(buffer) and buffer[pos] == "]":
+                    return
+                try:
+                    if pos == len(buffer):
+                        raise json.JSONDecodeError("need more data", buffer, pos)
+                    channel, end = decoder.raw_decode(buffer, pos)
+                except json.JSONDecodeError as error:
+                    # the current channel is not completely in the buffer yet unless more data cannot fix the error
+                    truncated = error.msg.startswith("Unterminated string") or \
+                        error.pos + MAX_TOKEN_SIZE >= len(buffer)
+                    if eof or not truncated:
+                        raise
+                    if len(buffer) - pos > MAX_RECORD_SIZE:
+                        raise ValueError("{} contains a channel of more than {} characters at offset {}".format(
+                            filename, MAX_RECORD_SIZE, offset + pos))
+                    chunk = f.read(READ_CHUNK_SIZE)
+                    eof = not chunk
+                    offset += pos
+                    buffer = buffer[pos:] + chunk
+                    pos = 0
+                    continue
+                pos = end
+                compact = {field: channel[field] for field in CHANNEL_FIELDS if field in channel}
+                for field in INTERNED_FIELDS:
+                    if field in compact:
+                        compact[field] = sys.intern(compact[field])
+                yield compact
 
     def __init__(self, lightning_cli_listchannels_json_file: str):
         """
@@ -28,21 +104,80 @@ class ChannelGraph:
         """
 
         self._channel_graph = nx.MultiDiGraph()
+        self._channel_index = {}
+        self._topology = None
         channels = self._get_channel_json(lightning_cli_listchannels_json_file)
+        self._add_channels(Channel(channel) for channel in channels)
+
+    @classmethod
+    def from_channels(cls, channels):
+        """
+        creates a ChannelGraph from `Channel` objects instead of a listchannels dump
+        """
+        channel_graph = cls.__new__(cls)
+        channel_graph._channel_graph = nx.MultiDiGraph()
+        channel_graph._channel_index = {}
+        channel_graph._topology = None
+        channel_graph._add_channels(channels)
+        return channel_graph
+
+    def _add_channels(self, channels):
         for channel in channels:
-            channel = Channel(channel)
             self._channel_graph.add_edge(
                 channel.src, channel.dest, key=channel.short_channel_id, channel=channel)
+            self._channel_index[(channel.short_channel_id, channel.direction)] = channel
+        self._topology = None
+
+    def apply_gossip(self, events):
+        """
+        applies a stream of `GossipEvent`s to the graph in place
+
+        Announcements and updates replace the `Channel` of the same short_channel_id and direction,
+        removals delete it. The `topology` is built again on its next use.
+        """
+        for event in events:
+            if event.event_type == GossipEventType.REMOVE:
+                channel = self._channel_index.pop(event.key, None)
+                if channel is not None:
+                    self._channel_graph.remove_edge(channel.src, channel.dest, key=channel.short_channel_id)
+            else:
+                self._add_channels([event.channel])
+        self._topology = None
+
+    @staticmethod
+    def _build_network(channels):
+        """
+        returns a `nx.MultiDiGraph` with the given channels as edges
+        """
+        network = nx.MultiDiGraph()
+        for channel in channels:
+            network.add_edge(channel.src, channel.dest, key=channel.short_channel_id, channel=channel)
+        return network
 
     @property
     def network(self):
         return self._channel_graph
 
+    @property
+    def topology(self):
+        """
+        the immutable `Topology` of the channels of the graph (its rows follow the order of the edges)
+        """
+        if self._topology is None:
+            self._topology = Topology([channel for _, _, channel in self.network.edges(data="channel")])
+        return self._topology
+
     def get_channel(self, src: str, dest: str, short_channel_id: str):
         """
         returns a specific channel object identified by source, destination and short_channel_id
         from the ChannelGraph
         """
-        if self.network.has_edge(src, dest):
-            if short_channel_id in self.network[src][dest]:
-                return self.network[src][dest][short_channel_id]["channel"]
+        channel = self.get_channel_by_id(short_channel_id, 0 if src < dest else 1)
+        if channel is not None and channel.src == src and channel.dest == dest:
+            return channel
+
+    def get_channel_by_id(self, short_channel_id: str, direction: int):
+        """
+        returns the channel with `short_channel_id` in `direction` (see `Channel.direction`) or None
+        """
+        return self._channel_index.get((short_channel_id, direction))
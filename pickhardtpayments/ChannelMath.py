@@ -0,0 +1,212 @@
+"""
+ChannelMath.py
+====================================
+Batch versions of the math of the `UncertaintyChannel` over arrays of rows of a `ChannelTable`.
+
+Simulations evaluate success probabilities, routing fees and updates of our belief for millions of hops,
+one python method call at a time. The functions here take the columns of the table and an array of rows
+instead. They are backed by the optional compiled extension `_channel_math` (built from
+`_channel_math.cpp` by `setup.py` if a C++ compiler is available) and fall back to numpy and plain python
+otherwise. Both agree exactly with the scalar methods of `UncertaintyChannel`, which stay the reference.
+
+`use_native(False)` switches to the fallback even if the extension is built, e.g. to compare the two.
+"""
+
+import numpy as np
+
+from .Linearization import MAX_CHANNEL_SIZE
+
+try:
+    from . import _channel_math as _native
+except ImportError:
+    try:
+        import _channel_math as _native
+    except ImportError:
+        _native = None
+
+NATIVE_AVAILABLE = _native is not None
+
+_use_native = NATIVE_AVAILABLE
+
+
+def use_native(enabled: bool = True):
+    """
+    selects the compiled kernels (if they are built) or the numpy fallback for all following calls
+    """
+    global _use_native
+    if enabled and not NATIVE_AVAILABLE:
+        raise ValueError("the _channel_math extension is not built")
+    _use_native = enabled
+
+
+def native_enabled():
+    return _use_native
+
+
+def _int64(values):
+    return np.ascontiguousarray(values, dtype=np.int64)
+
+
+def _amounts(amounts, rows):
+    """
+    the amount of every row as an array (a single amount is used for all rows)
+    """
+    amounts = np.asarray(amounts, dtype=np.int64)
+    if amounts.ndim == 0:
+        return np.full(len(rows), int(amounts), dtype=np.int64)
+    return _int64(amounts)
+
+
+def _conditional_capacity(min_liquidity, max_liquidity, in_flight, rows):
+    return np.maximum(max_liquidity[rows] - np.maximum(min_liquidity[rows], in_flight[rows]), 0)
+
+
+def uniform_success_probability(min_liquidity, max_liquidity, tested_liquidity):
+    """
+    the probability that channels whose liquidity is uniformly distributed in [min_liquidity, max_liquidity]
+    hold at least `tested_liquidity` (all arguments are arrays over the same channels)
+    """
+    conditional_amount = tested_liquidity - min_liquidity
+    conditional_capacity = max_liquidity - min_liquidity
+    with np.errstate(divide="ignore", invalid="ignore"):
+        probability = (conditional_capacity + 1 - conditional_amount) / (conditional_capacity + 1)
+    probability[conditional_amount > conditional_capacity] = 0.
+    probability[tested_liquidity >= max_liquidity] = 0.
+    probability[tested_liquidity <= min_liquidity] = 1.
+    return probability
+
+
+def entropy(min_liquidity, max_liquidity, in_flight, rows=None) -> float:
+    """
+    sum of `UncertaintyChannel.entropy` over the given rows (over all rows if `rows` is None)
+    """
+    if _use_native:
+        return _native.entropy(min_liquidity, max_liquidity, in_flight, None if rows is None else _int64(rows))
+    if rows is None:
+        rows = slice(None)
+    return float(np.log2(_conditional_capacity(min_liquidity, max_liquidity, in_flight, rows) + 1).sum())
+
+
+def success_probabilities(min_liquidity, max_liquidity, in_flight, rows, amounts):
+    """
+    `UncertaintyChannel.success_probability` of sending the amount (or the amount of every row) through the
+    given rows on top of their in_flight allocations
+    """
+    rows = _int64(rows)
+    amounts = _amounts(amounts, rows)
+    if _use_native:
+        probabilities = np.empty(len(rows), dtype=np.float64)
+        _native.success_probabilities(min_liquidity, max_liquidity, in_flight, rows, amounts, probabilities)
+        return probabilities
+    return uniform_success_probability(min_liquidity[rows], max_liquidity[rows], amounts + in_flight[rows])
+
+
+def uncertainty_costs(min_liquidity, max_liquidity, in_flight, rows, amounts):
+    """
+    `UncertaintyChannel.uncertainty_cost` of the given rows in bits (inf where the amount cannot be sent)
+    """
+    rows = _int64(rows)
+    amounts = _amounts(amounts, rows)
+    if _use_native:
+        costs = np.empty(len(rows), dtype=np.float64)
+        _native.uncertainty_costs(min_liquidity, max_liquidity, in_flight, rows, amounts, costs)
+        return costs
+    with np.errstate(divide="ignore"):
+        return -np.log2(uniform_success_probability(min_liquidity[rows], max_liquidity[rows],
+                                                    amounts + in_flight[rows]))
+
+
+def linearized_integer_uncertainty_unit_costs(min_liquidity, max_liquidity, in_flight, rows):
+    """
+    `UncertaintyChannel.linearized_integer_uncertainty_unit_cost` of the given rows (0 for rows without
+    conditional capacity which have no uncertain piece)
+    """
+    rows = _int64(rows)
+    if _use_native:
+        costs = np.empty(len(rows), dtype=np.int64)
+        _native.linearized_integer_uncertainty_unit_costs(min_liquidity, max_liquidity, in_flight, rows,
+                                                          MAX_CHANNEL_SIZE, costs)
+        return costs
+    conditional_capacity = _conditional_capacity(min_liquidity, max_liquidity, in_flight, rows)
+    with np.errstate(divide="ignore", invalid="ignore"):
+        costs = (MAX_CHANNEL_SIZE / conditional_capacity).astype(np.int64)
+    costs[conditional_capacity == 0] = 0
+    return costs
+
+
+def routing_costs_msat(ppm, base_fee, rows, amounts):
+    """
+    `UncertaintyChannel.routing_cost_msat` of forwarding the amount (or the amount of every row) through the
+    given rows
+    """
+    rows = _int64(rows)
+    amounts = _amounts(amounts, rows)
+    if _use_native:
+        costs = np.empty(len(rows), dtype=np.int64)
+        _native.routing_costs_msat(ppm, base_fee, rows, amounts, costs)
+        return costs
+    return (ppm[rows] * amounts / 1000).astype(np.int64) + base_fee[rows]
+
+
+def score_path(min_liquidity, max_liquidity, in_flight, ppm, base_fee, rows, amount: int):
+    """
+    returns the routing fee in msat and the success probability of sending `amount` along the rows of a path
+
+    As in `Attempt` the amount is allocated hop by hop, so a channel that occurs twice on the path has to
+    hold the amount twice. The in_flight amounts themselves are not changed.
+    """
+    rows = _int64(rows)
+    if _use_native:
+        return _native.score_path(min_liquidity, max_liquidity, in_flight, ppm, base_fee, rows, int(amount))
+    fee = 0
+    probability = 1.
+    allocated = {}
+    for row in rows.tolist():
+        allocated[row] = allocated.get(row, 0) + amount
+        fee += int(int(ppm[row]) * amount / 1000) + int(base_fee[row])
+        tested_liquidity = int(in_flight[row]) + allocated[row]
+        lower, upper = int(min_liquidity[row]), int(max_liquidity[row])
+        if tested_liquidity >= upper and tested_liquidity > lower:
+            probability *= 0.
+        elif tested_liquidity > lower:
+            probability *= float(upper + 1 - tested_liquidity) / (upper - lower + 1)
+    return fee, probability
+
+
+def update_knowledge(min_liquidity, max_liquidity, in_flight, rows, amounts, success):
+    """
+    applies `UncertaintyChannel.update_knowledge` to the given rows in order and writes the new bounds into
+    `min_liquidity` and `max_liquidity`
+
+    `success` flags the rows whose probe of the amount (on top of their in_flight amount) succeeded.
+    """
+    rows = _int64(rows)
+    amounts = _amounts(amounts, rows)
+    success = np.ascontiguousarray(success, dtype=bool)
+    if _use_native:
+        _native.update_knowledge(min_liquidity, max_liquidity, in_flight, rows, amounts, success)
+        return
+    for row, amount, succeeded in zip(rows.tolist(), amounts.tolist(), success.tolist()):
+        tested_liquidity = int(in_flight[row]) + amount
+        if succeeded:
+            min_liquidity[row] = max(int(min_liquidity[row]), tested_liquidity)
+        else:
+            max_liquidity[row] = min(int(max_liquidity[row]), tested_liquidity)
+
+
+def probe_path(actual_liquidity, oracle_rows, in_flight, rows, amount: int) -> int:
+    """
+    returns the index of the first hop of a path that cannot forward its in_flight amount plus `amount`
+    (-1 if the onion arrives) as `OracleLightningNetwork.send_onion` probes them
+
+    `rows` are the rows of the hops in the table of `in_flight` and `oracle_rows` their rows in
+    `actual_liquidity`.
+    """
+    oracle_rows = _int64(oracle_rows)
+    rows = _int64(rows)
+    if _use_native:
+        return _native.probe_path(actual_liquidity, oracle_rows, in_flight, rows, int(amount))
+    for hop, (oracle_row, row) in enumerate(zip(oracle_rows.tolist(), rows.tolist())):
+        if int(in_flight[row]) + amount > int(actual_liquidity[oracle_row]):
+            return hop
+    return -1
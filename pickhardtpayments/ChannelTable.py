@@ -0,0 +1,700 @@
+import time
+from math import exp, log
+from typing import List
+
+import numpy as np
+
+from .Channel import Channel
+from .Topology import Topology
+from .Linearization import piecewise_linearized_costs, piecewise_linearized_arcs, \
+    adaptive_piecewise_linearized_costs, DEFAULT_MAX_ERROR
+from . import ChannelMath
+from .ChannelMath import uniform_success_probability
+
+DEFAULT_MU = 1
+DEFAULT_N = 5
+
+
+class ChannelTable:
+    """
+    A compact columnar (struct of arrays) store for the channels of a network.
+
+    Instead of asking every channel object for its `capacity`, `ppm` or our belief about its liquidity
+    the `ChannelTable` keeps these values in contiguous integer arrays. Every channel is identified by
+    its row in the table. This allows to compute network wide quantities like the entropy or the
+    piecewise linearization of all channels with vectorized passes over the arrays.
+
+    Nodes are mapped to dense integer indices in order of their appearance and the short_channel_id
+    is mapped to a dense index as well. Together with the direction of the channel (0 if the source
+    has the lexicographically smaller node id, as in the gossip protocol) it identifies a row.
+
+    Every modification of our belief or of the in_flight allocation of rows bumps the `version` of the
+    table and stores it in `row_versions`, so anyone who remembers the version at some point can tell
+    whether given rows changed since (see `changed_since`) or which rows did (see `changed_rows_since`).
+    Every consumer remembers its own version, so consumers do not take changes away from one another.
+    Modifications of the belief itself (not of the in_flight allocations) are also stored in
+    `belief_versions` (see `belief_changed_since`).
+
+    Every time we learn something about a channel the table remembers the belief at that moment and the
+    timestamp in `learnt_at` (0 if we never learnt anything). If a `half_life` (in seconds) is set, our
+    belief decays: the distance of `min_liquidity` to 0 and of `max_liquidity` to the capacity halves
+    every `half_life` seconds, as the liquidity of a channel changes over time. The decay is applied
+    lazily to the rows that are read via `decay`, so there is no maintenance pass over the whole graph.
+    """
+
+    def __init__(self, channels: List[Channel]):
+        self._node_ids = []
+        self._node_index = {}
+        self._short_channel_ids = []
+        self._short_channel_id_index = {}
+        self._row_index = {}
+
+        src, dest, short_channel_id = [], [], []
+        for row, channel in enumerate(channels):
+            src.append(self._add_node(channel.src))
+            dest.append(self._add_node(channel.dest))
+            scid = self._short_channel_id_index.get(channel.short_channel_id)
+            if scid is None:
+                scid = len(self._short_channel_ids)
+                self._short_channel_id_index[channel.short_channel_id] = scid
+                self._short_channel_ids.append(channel.short_channel_id)
+            short_channel_id.append(scid)
+            self._row_index[(channel.short_channel_id, self.direction(channel.src, channel.dest))] = row
+
+        self._src = np.array(src, dtype=np.int64)
+        self._dest = np.array(dest, dtype=np.int64)
+        self._short_channel_id = np.array(short_channel_id, dtype=np.int64)
+        self._capacity = np.array([channel.capacity for channel in channels], dtype=np.int64)
+        self._ppm = np.array([channel.ppm for channel in channels], dtype=np.int64)
+        self._base_fee = np.array([channel.base_fee for channel in channels], dtype=np.int64)
+
+        self._min_liquidity = np.zeros(len(channels), dtype=np.int64)
+        self._max_liquidity = self._capacity.copy()
+        self._in_flight = np.zeros(len(channels), dtype=np.int64)
+        self._init_learning()
+        self._shares_topology = False
+
+    def _init_learning(self, learnt_at=None, learnt_min_liquidity=None, learnt_max_liquidity=None):
+        """
+        the belief at the time we learnt it from which the decayed belief is computed
+        """
+        rows = len(self._capacity)
+        self._learnt_at = np.zeros(rows, dtype=np.float64) if learnt_at is None else learnt_at
+        self._learnt_min_liquidity = self._min_liquidity.copy() if learnt_min_liquidity is None \
+            else learnt_min_liquidity
+        self._learnt_max_liquidity = self._max_liquidity.copy() if learnt_max_liquidity is None \
+            else learnt_max_liquidity
+        self._removed = np.zeros(rows, dtype=bool)
+        self._half_life = None
+        self._version = 0
+        self._row_versions = np.zeros(rows, dtype=np.int64)
+        self._belief_versions = np.zeros(rows, dtype=np.int64)
+
+    @classmethod
+    def from_arrays(cls, node_ids: List[str], short_channel_ids: List[str], src, dest, short_channel_id, capacity,
+                    ppm, base_fee, min_liquidity, max_liquidity, in_flight, learnt_at=None,
+                    learnt_min_liquidity=None, learnt_max_liquidity=None):
+        """
+        creates a table directly from its columns without copying them
+
+        `src`, `dest` and `short_channel_id` hold indices into `node_ids` and `short_channel_ids`. The arrays
+        may be views on a memory mapped snapshot (see `Snapshot`), in which case changes of our belief are
+        written to the mapping. Without `learnt_at` the belief is treated as never learnt and does not decay.
+        """
+        table = cls.__new__(cls)
+        table._node_ids = list(node_ids)
+        table._node_index = {node_id: index for index, node_id in enumerate(table._node_ids)}
+        table._short_channel_ids = list(short_channel_ids)
+        table._short_channel_id_index = {scid: index for index, scid in enumerate(table._short_channel_ids)}
+        table._src = src
+        table._dest = dest
+        table._short_channel_id = short_channel_id
+        table._capacity = capacity
+        table._ppm = ppm
+        table._base_fee = base_fee
+        table._min_liquidity = min_liquidity
+        table._max_liquidity = max_liquidity
+        table._in_flight = in_flight
+        table._init_learning(learnt_at, learnt_min_liquidity, learnt_max_liquidity)
+        table._row_index = {}
+        for row, (s, d, scid) in enumerate(zip(np.asarray(src).tolist(), np.asarray(dest).tolist(),
+                                               np.asarray(short_channel_id).tolist())):
+            direction = cls.direction(table._node_ids[s], table._node_ids[d])
+            table._row_index[(table._short_channel_ids[scid], direction)] = row
+        table._shares_topology = False
+        return table
+
+    @classmethod
+    def from_topology(cls, topology: Topology, active=None):
+        """
+        creates a table with a fresh belief on top of a `Topology`
+
+        The rows of the table are the rows of the topology. The node and channel indices and the static
+        columns are shared with the topology instead of being copied until gossip changes them. Rows that
+        are not flagged in the boolean mask `active` (e.g. channels above a base fee threshold) are
+        `removed` from the start and have no capacity, which only copies the capacity column.
+        """
+        inactive = None
+        if active is not None and not np.asarray(active, dtype=bool).all():
+            inactive = ~np.asarray(active, dtype=bool)
+        table = cls.__new__(cls)
+        table._node_ids = topology.node_ids
+        table._node_index = topology.node_index
+        table._short_channel_ids = topology.short_channel_ids
+        table._short_channel_id_index = topology.short_channel_id_index
+        table._row_index = topology.row_index
+        table._src = topology.src
+        table._dest = topology.dest
+        table._short_channel_id = topology.short_channel_id
+        table._capacity = topology.capacity if inactive is None else np.where(inactive, 0, topology.capacity)
+        table._ppm = topology.ppm
+        table._base_fee = topology.base_fee
+        table._min_liquidity = np.zeros(len(topology), dtype=np.int64)
+        table._max_liquidity = table._capacity.copy()
+        table._in_flight = np.zeros(len(topology), dtype=np.int64)
+        table._init_learning()
+        if inactive is not None:
+            table._removed[inactive] = True
+        table._shares_topology = True
+        return table
+
+    def __len__(self):
+        return len(self._capacity)
+
+    def _add_node(self, node_id: str):
+        index = self._node_index.get(node_id)
+        if index is None:
+            index = len(self._node_ids)
+            self._node_index[node_id] = index
+            self._node_ids.append(node_id)
+        return index
+
+    @staticmethod
+    def direction(src: str, dest: str):
+        """
+        the direction of a channel as used in the gossip protocol
+        """
+        return 0 if src < dest else 1
+
+    @property
+    def number_of_nodes(self):
+        return len(self._node_ids)
+
+    @property
+    def node_ids(self):
+        return self._node_ids
+
+    @property
+    def node_index(self):
+        return self._node_index
+
+    @property
+    def short_channel_ids(self):
+        return self._short_channel_ids
+
+    def get_row(self, short_channel_id: str, direction: int):
+        """
+        returns the row of the channel with `short_channel_id` in the given direction or None (also for
+        `removed` rows)
+        """
+        row = self._row_index.get((short_channel_id, direction))
+        if row is not None and not self._removed[row]:
+            return row
+
+    @property
+    def src(self):
+        return self._src
+
+    @property
+    def dest(self):
+        return self._dest
+
+    @property
+    def short_channel_id(self):
+        return self._short_channel_id
+
+    @property
+    def capacity(self):
+        return self._capacity
+
+    @property
+    def ppm(self):
+        return self._ppm
+
+    @property
+    def base_fee(self):
+        return self._base_fee
+
+    @property
+    def min_liquidity(self):
+        return self._min_liquidity
+
+    @property
+    def max_liquidity(self):
+        return self._max_liquidity
+
+    @property
+    def in_flight(self):
+        return self._in_flight
+
+    @property
+    def version(self):
+        """
+        the number of modifications of the table so far
+        """
+        return self._version
+
+    @property
+    def row_versions(self):
+        """
+        the `version` of the table at the last modification of every row (0 if it was never modified)
+        """
+        return self._row_versions
+
+    @property
+    def belief_versions(self):
+        """
+        the `version` of the table at the last modification of the belief of every row (0 if it never was)
+        """
+        return self._belief_versions
+
+    def mark_changed(self, rows, belief: bool = True):
+        """
+        bumps the version of the given rows
+
+        `belief` is False if only the in_flight allocations of the rows changed.
+        """
+        self._version += 1
+        self._row_versions[rows] = self._version
+        if belief:
+            self._belief_versions[rows] = self._version
+
+    def changed_since(self, rows, version: int):
+        """
+        returns whether one of the given rows was modified after the table had `version`
+        """
+        return len(rows) > 0 and int(self._row_versions[rows].max()) > version
+
+    def changed_rows_since(self, version: int):
+        """
+        returns the rows whose belief or in_flight allocation was modified after the table had `version`
+        """
+        return np.flatnonzero(self._row_versions > version)
+
+    def belief_changed_since(self, rows, version: int):
+        """
+        returns whether our belief about one of the given rows was modified after the table had `version`
+        """
+        return len(rows) > 0 and int(self._belief_versions[rows].max()) > version
+
+    @property
+    def removed(self):
+        """
+        flags the rows of channels that were closed (see `remove_rows`) or that were not active when the table
+        was created (see `from_topology`)
+        """
+        return self._removed
+
+    @property
+    def learnt_at(self):
+        return self._learnt_at
+
+    @property
+    def learnt_min_liquidity(self):
+        return self._learnt_min_liquidity
+
+    @property
+    def learnt_max_liquidity(self):
+        return self._learnt_max_liquidity
+
+    @property
+    def half_life(self):
+        return self._half_life
+
+    @half_life.setter
+    def half_life(self, seconds: float):
+        """
+        the time in seconds in which our belief loses half of its information. None disables the decay
+        """
+        if seconds is not None and seconds <= 0:
+            raise ValueError("the half life of our belief has to be positive")
+        self._half_life = seconds
+
+    def decay_row(self, row: int, now: float = None):
+        """
+        applies the decay to our belief about a single row. Scalar version of `decay`
+        """
+        if self._half_life is None:
+            return
+        learnt_at = float(self._learnt_at[row])
+        if learnt_at == 0:
+            return
+        if now is None:
+            now = time.time()
+        factor = exp(-max(now - learnt_at, 0) * log(2) / self._half_life)
+        capacity = int(self._capacity[row])
+        min_liquidity = int(int(self._learnt_min_liquidity[row]) * factor + 0.5)
+        max_liquidity = capacity - int((capacity - int(self._learnt_max_liquidity[row])) * factor + 0.5)
+        if min_liquidity != self._min_liquidity[row] or max_liquidity != self._max_liquidity[row]:
+            self._min_liquidity[row] = min_liquidity
+            self._max_liquidity[row] = max_liquidity
+            self.mark_changed(row)
+
+    def decay(self, rows=None, now: float = None):
+        """
+        widens our belief about the given rows (about all rows if `rows` is None) towards [0, capacity]
+        according to the time that passed since we learnt it. Only rows whose belief changes get a new version.
+
+        The decayed belief is always computed from the belief at the time of learning, so applying the
+        decay often does not let it decay faster.
+        """
+        if self._half_life is None:
+            return
+        if rows is None:
+            rows = np.arange(len(self))
+        rows = rows[self._learnt_at[rows] > 0]
+        if len(rows) == 0:
+            return
+        min_liquidity, max_liquidity = self._decayed_belief(rows, now)
+        modified = (min_liquidity != self._min_liquidity[rows]) | (max_liquidity != self._max_liquidity[rows])
+        rows = rows[modified]
+        if len(rows) == 0:
+            return
+        self._min_liquidity[rows] = min_liquidity[modified]
+        self._max_liquidity[rows] = max_liquidity[modified]
+        self.mark_changed(rows)
+
+    def _decayed_belief(self, rows, now: float = None):
+        """
+        returns the decayed `min_liquidity` and `max_liquidity` of `rows` (which need a `learnt_at` > 0)
+        without storing them
+        """
+        if now is None:
+            now = time.time()
+        factor = np.exp(np.maximum(now - self._learnt_at[rows], 0) * (-log(2) / self._half_life))
+        capacity = self._capacity[rows]
+        min_liquidity = (self._learnt_min_liquidity[rows] * factor + 0.5).astype(np.int64)
+        max_liquidity = capacity - ((capacity - self._learnt_max_liquidity[rows]) * factor + 0.5).astype(np.int64)
+        return min_liquidity, max_liquidity
+
+    def belief(self, rows, now: float = None):
+        """
+        returns copies of `min_liquidity` and `max_liquidity` of `rows` with the decay applied
+
+        Unlike `decay` nothing is written to the table, so the belief can be read from several threads
+        while the table is not modified.
+        """
+        rows = np.asarray(rows, dtype=np.int64)
+        min_liquidity = self._min_liquidity[rows]
+        max_liquidity = self._max_liquidity[rows]
+        if self._half_life is None:
+            return min_liquidity, max_liquidity
+        learnt = np.flatnonzero(self._learnt_at[rows] > 0)
+        if len(learnt) > 0:
+            min_liquidity[learnt], max_liquidity[learnt] = self._decayed_belief(rows[learnt], now)
+        return min_liquidity, max_liquidity
+
+    def learn(self, row: int, min_liquidity: int = None, max_liquidity: int = None, now: float = None):
+        """
+        stores what we learnt about the liquidity of `row` together with the current timestamp
+
+        The bound that is not given keeps its decayed value which becomes the new reference for the decay.
+        """
+        if now is None:
+            now = time.time()
+        self.decay_row(row, now)
+        if min_liquidity is not None:
+            self._min_liquidity[row] = min_liquidity
+        if max_liquidity is not None:
+            self._max_liquidity[row] = max_liquidity
+        self._learnt_min_liquidity[row] = self._min_liquidity[row]
+        self._learnt_max_liquidity[row] = self._max_liquidity[row]
+        self._learnt_at[row] = now
+        self.mark_changed(row)
+
+    def learn_n_bits(self, actual_liquidity, n: int, rows=None, now: float = None):
+        """
+        vectorized version of `UncertaintyChannel.learn_n_bits` which probes the given rows (all rows if
+        `rows` is None) `n` times via binary search against their `actual_liquidity`
+
+        All rows are searched at once with one pass over the arrays per bit. Once no interval changes
+        anymore further probes cannot change it either, so the search stops early. As in the scalar
+        version every probed row counts as learnt at `now`.
+        """
+        if n <= 0:
+            return
+        if rows is None:
+            rows = np.arange(len(self))
+        if now is None:
+            now = time.time()
+        self.decay(rows, now)
+        actual_liquidity = np.asarray(actual_liquidity, dtype=np.int64)
+        min_liquidity = self._min_liquidity[rows]
+        max_liquidity = self._max_liquidity[rows]
+        in_flight = self._in_flight[rows]
+        for _ in range(n):
+            # rounds towards zero like int() in the scalar version
+            width = max_liquidity - min_liquidity
+            amt = min_liquidity + np.where(width >= 0, width // 2, -(-width // 2))
+            success = amt <= actual_liquidity
+            new_min_liquidity = np.where(success, np.maximum(min_liquidity, in_flight + amt), min_liquidity)
+            new_max_liquidity = np.where(success, max_liquidity, np.minimum(max_liquidity, in_flight + amt))
+            if np.array_equal(new_min_liquidity, min_liquidity) and np.array_equal(new_max_liquidity, max_liquidity):
+                break
+            min_liquidity, max_liquidity = new_min_liquidity, new_max_liquidity
+        self._min_liquidity[rows] = min_liquidity
+        self._max_liquidity[rows] = max_liquidity
+        self._learnt_min_liquidity[rows] = min_liquidity
+        self._learnt_max_liquidity[rows] = max_liquidity
+        self._learnt_at[rows] = now
+        self.mark_changed(rows)
+
+    def forget_information(self, rows=None):
+        """
+        resets our belief and the in_flight allocation of the given rows (of all rows if `rows` is None)
+        """
+        if rows is None:
+            rows = slice(None)
+        self._min_liquidity[rows] = 0
+        self._max_liquidity[rows] = self._capacity[rows]
+        self._in_flight[rows] = 0
+        self._learnt_min_liquidity[rows] = 0
+        self._learnt_max_liquidity[rows] = self._capacity[rows]
+        self._learnt_at[rows] = 0
+        self.mark_changed(rows)
+
+    def _own_columns(self):
+        """
+        copies the indices and static columns that are shared with a `Topology` before they are changed
+        """
+        if not self._shares_topology:
+            return
+        self._node_ids = list(self._node_ids)
+        self._node_index = dict(self._node_index)
+        self._short_channel_ids = list(self._short_channel_ids)
+        self._short_channel_id_index = dict(self._short_channel_id_index)
+        self._row_index = dict(self._row_index)
+        self._capacity = self._capacity.copy()
+        self._ppm = self._ppm.copy()
+        self._base_fee = self._base_fee.copy()
+        self._shares_topology = False
+
+    def update_channels(self, rows, channels: List[Channel]):
+        """
+        takes over the capacity and the fees of the `channels` (e.g. from a `channel_update`) in the given
+        rows while our belief is kept. Only if the capacity shrinks the belief is limited to it.
+        """
+        if len(rows) == 0:
+            return
+        self._own_columns()
+        rows = np.asarray(rows, dtype=np.int64)
+        self._capacity[rows] = [channel.capacity for channel in channels]
+        self._ppm[rows] = [channel.ppm for channel in channels]
+        self._base_fee[rows] = [channel.base_fee for channel in channels]
+        capacity = self._capacity[rows]
+        self._max_liquidity[rows] = np.minimum(self._max_liquidity[rows], capacity)
+        self._min_liquidity[rows] = np.minimum(self._min_liquidity[rows], self._max_liquidity[rows])
+        self._learnt_max_liquidity[rows] = np.minimum(self._learnt_max_liquidity[rows], capacity)
+        self._learnt_min_liquidity[rows] = np.minimum(self._learnt_min_liquidity[rows],
+                                                      self._learnt_max_liquidity[rows])
+        self.mark_changed(rows)
+
+    def remove_rows(self, rows):
+        """
+        closes the channels of the given rows
+
+        The rows stay in the table so that the rows of all other channels do not change, but they lose
+        their capacity and belief, are flagged as `removed` and cannot be looked up via `get_row` anymore.
+        """
+        if len(rows) == 0:
+            return
+        self._own_columns()
+        rows = np.asarray(rows, dtype=np.int64)
+        for row in rows.tolist():
+            self._row_index.pop((self._short_channel_ids[self._short_channel_id[row]],
+                                 self.direction(self._node_ids[self._src[row]], self._node_ids[self._dest[row]])),
+                                None)
+        self._capacity[rows] = 0
+        self.forget_information(rows)
+        self._removed[rows] = True
+
+    def append_channels(self, channels: List[Channel]):
+        """
+        adds rows with a fresh belief for newly announced `channels` and returns their rows
+
+        The columns grow by one concatenation for all channels. Note that the belief of a table that was
+        loaded from a `Snapshot` is not written to the mapping anymore once the table grew.
+        """
+        self._own_columns()
+        first = len(self)
+        src, dest, short_channel_id = [], [], []
+        for row, channel in enumerate(channels, first):
+            src.append(self._add_node(channel.src))
+            dest.append(self._add_node(channel.dest))
+            scid = self._short_channel_id_index.get(channel.short_channel_id)
+            if scid is None:
+                scid = len(self._short_channel_ids)
+                self._short_channel_id_index[channel.short_channel_id] = scid
+                self._short_channel_ids.append(channel.short_channel_id)
+            short_channel_id.append(scid)
+            self._row_index[(channel.short_channel_id, self.direction(channel.src, channel.dest))] = row
+        capacity = np.array([channel.capacity for channel in channels], dtype=np.int64)
+        zeros = np.zeros(len(channels), dtype=np.int64)
+        self._src = np.concatenate([self._src, np.array(src, dtype=np.int64)])
+        self._dest = np.concatenate([self._dest, np.array(dest, dtype=np.int64)])
+        self._short_channel_id = np.concatenate([self._short_channel_id, np.array(short_channel_id, dtype=np.int64)])
+        self._capacity = np.concatenate([self._capacity, capacity])
+        self._ppm = np.concatenate([self._ppm, np.array([channel.ppm for channel in channels], dtype=np.int64)])
+        self._base_fee = np.concatenate([self._base_fee, np.array([channel.base_fee for channel in channels],
+                                                                  dtype=np.int64)])
+        self._min_liquidity = np.concatenate([self._min_liquidity, zeros])
+        self._max_liquidity = np.concatenate([self._max_liquidity, capacity])
+        self._in_flight = np.concatenate([self._in_flight, zeros])
+        self._learnt_at = np.concatenate([self._learnt_at, np.zeros(len(channels), dtype=np.float64)])
+        self._learnt_min_liquidity = np.concatenate([self._learnt_min_liquidity, zeros])
+        self._learnt_max_liquidity = np.concatenate([self._learnt_max_liquidity, capacity])
+        self._removed = np.concatenate([self._removed, np.zeros(len(channels), dtype=bool)])
+        self._row_versions = np.concatenate([self._row_versions, zeros])
+        self._belief_versions = np.concatenate([self._belief_versions, zeros])
+        rows = np.arange(first, len(self), dtype=np.int64)
+        self.mark_changed(rows)
+        return rows
+
+    def conditional_capacity(self, rows=None):
+        """
+        vectorized version of `UncertaintyChannel.conditional_capacity` respecting in_flight allocations
+        """
+        self.decay(rows)
+        if rows is None:
+            rows = slice(None)
+        min_liquidity = np.maximum(self._min_liquidity[rows], self._in_flight[rows])
+        return np.maximum(self._max_liquidity[rows] - min_liquidity, 0)
+
+    def entropy(self, rows=None):
+        """
+        sum of `UncertaintyChannel.entropy` over the given rows (over all rows if `rows` is None)
+        """
+        self.decay(rows)
+        return ChannelMath.entropy(self._min_liquidity, self._max_liquidity, self._in_flight, rows)
+
+    def success_probability(self, amt: int = 0, rows=None):
+        """
+        vectorized version of `UncertaintyChannel.success_probability` for sending `amt` through every row
+        """
+        self.decay(rows)
+        if rows is None:
+            rows = slice(None)
+        return uniform_success_probability(self._min_liquidity[rows], self._max_liquidity[rows],
+                                           amt + self._in_flight[rows])
+
+    def uncertainty_cost(self, amt, rows):
+        """
+        vectorized version of `UncertaintyChannel.uncertainty_cost` for sending `amt` (or an amount per row)
+        """
+        self.decay(rows)
+        return ChannelMath.uncertainty_costs(self._min_liquidity, self._max_liquidity, self._in_flight, rows, amt)
+
+    def linearized_integer_uncertainty_unit_cost(self, rows):
+        """
+        vectorized version of `UncertaintyChannel.linearized_integer_uncertainty_unit_cost` (see
+        `ChannelMath.linearized_integer_uncertainty_unit_costs`)
+        """
+        self.decay(rows)
+        return ChannelMath.linearized_integer_uncertainty_unit_costs(self._min_liquidity, self._max_liquidity,
+                                                                     self._in_flight, rows)
+
+    def routing_cost_msat(self, amt, rows):
+        """
+        vectorized version of `UncertaintyChannel.routing_cost_msat` for forwarding `amt` (or an amount per row)
+        """
+        return ChannelMath.routing_costs_msat(self._ppm, self._base_fee, rows, amt)
+
+    def score_path(self, rows, amt: int):
+        """
+        returns the routing fee in msat and the success probability of sending `amt` along the rows of a path
+        as `Attempt` computes them before it allocates the amount
+        """
+        self.decay(rows)
+        return ChannelMath.score_path(self._min_liquidity, self._max_liquidity, self._in_flight, self._ppm,
+                                      self._base_fee, rows, amt)
+
+    def allocate_amount(self, rows, amt: int):
+        """
+        vectorized version of `UncertaintyChannel.allocate_amount` that assigns `amt` to every row in flight
+        """
+        np.add.at(self._in_flight, rows, amt)
+        if (self._in_flight[rows] < 0).any():
+            np.add.at(self._in_flight, rows, -amt)
+            raise Exception("Can't remove in flight HTLC of amt {} on all rows".format(-amt))
+        self.mark_changed(rows, belief=False)
+
+    def update_knowledge(self, rows, amt, success, now: float = None):
+        """
+        vectorized version of `UncertaintyChannel.update_knowledge` for probes of `amt` (or an amount per row)
+        that succeeded on the rows flagged in `success`, applied in the order of `rows`
+
+        All rows count as learnt at `now`.
+        """
+        if now is None:
+            now = time.time()
+        rows = np.asarray(rows, dtype=np.int64)
+        self.decay(rows, now)
+        ChannelMath.update_knowledge(self._min_liquidity, self._max_liquidity, self._in_flight, rows, amt, success)
+        self._learnt_min_liquidity[rows] = self._min_liquidity[rows]
+        self._learnt_max_liquidity[rows] = self._max_liquidity[rows]
+        self._learnt_at[rows] = now
+        self.mark_changed(rows)
+
+    def get_piecewise_linearized_costs(self, rows, number_of_pieces: int, mu: int):
+        """
+        vectorized version of `UncertaintyChannel.get_piecewise_linearized_costs` for the given rows
+
+        returns three arrays `capacities`, `costs` of shape (len(rows), number_of_pieces) and `used` of
+        shape (len(rows),). The pieces of each row are stored in the first `used` columns in the same order
+        as the scalar method returns them. Unused columns have zero capacity and zero cost.
+        """
+        self.decay(rows)
+        return piecewise_linearized_costs(self._min_liquidity[rows], self._max_liquidity[rows],
+                                          self._in_flight[rows], self._ppm[rows], mu, number_of_pieces)
+
+    def get_adaptive_piecewise_linearized_costs(self, rows, mu: int, amt: int, max_error: float = DEFAULT_MAX_ERROR,
+                                                max_pieces: int = DEFAULT_N):
+        """
+        vectorized non uniform linearization of the given rows for a payment of `amt` (see
+        `Linearization.adaptive_piecewise_linearized_costs`)
+
+        returns `capacities`, `costs` of shape (len(rows), max_pieces) and `used` in the same layout as
+        `get_piecewise_linearized_costs`.
+        """
+        self.decay(rows)
+        return adaptive_piecewise_linearized_costs(self._min_liquidity[rows], self._max_liquidity[rows],
+                                                   self._in_flight[rows], self._ppm[rows], mu, amt, max_error,
+                                                   max_pieces)
+
+    def get_piecewise_linearized_arcs(self, rows=None, number_of_pieces: int = DEFAULT_N, mu: int = DEFAULT_MU):
+        """
+        computes the arcs of the piecewise linearization of the given rows (of all rows if `rows` is None)
+
+        returns the flat arrays `channel_rows`, `tails`, `heads`, `capacities` and `costs` which can be
+        handed to the min cost flow solver in one call. Tails and heads are node indices of the table.
+        """
+        if rows is None:
+            rows = np.arange(len(self))
+        self.decay(rows)
+        owner, tails, heads, capacities, costs = piecewise_linearized_arcs(
+            self._src[rows], self._dest[rows], self._min_liquidity[rows], self._max_liquidity[rows],
+            self._in_flight[rows], self._ppm[rows], mu, number_of_pieces)
+        return rows[owner], tails, heads, capacities, costs
+
+
+def path_rows(path):
+    """
+    returns the `ChannelTable` that all channels of `path` are views on and their rows
+
+    Returns None and None if the path is empty or its channels are no `UncertaintyChannels` of one table.
+    """
+    channel_table = getattr(path[0], "channel_table", None) if path else None
+    if channel_table is None or any(getattr(channel, "channel_table", None) is not channel_table
+                                    for channel in path):
+        return None, None
+    return channel_table, np.array([channel.row for channel in path], dtype=np.int64)
@@ -0,0 +1,70 @@
+import numpy as np
+
+DEFAULT_MAX_BASE_FEE = 1_000
+DEFAULT_MAX_ITERATIONS = 4
+DEFAULT_TIME_BUDGET = 1.0
+
+
+class FixedChargeApproximation:
+    """
+    Lets channels with a base fee into the min cost flow problem instead of dropping them.
+
+    The base fee is a fixed charge for using a channel at all, which a min cost flow cannot express. It is
+    approximated by a surcharge on the unit cost of the channel: the base fee spread over the amount the
+    channel is expected to carry. Initially that amount is the smaller of its capacity in the model and the
+    payment, which overestimates nothing but underestimates the unit cost of channels that end up carrying
+    little. Hence the problem is solved again with the expected amounts set to the flow of the previous
+    solution (dynamic slope scaling), so that the surcharge of a used channel matches its base fee exactly.
+    Channels without flow keep their estimate.
+
+    The iterations stop when the flow does not change anymore, after `max_iterations` solves or when the
+    next solve would exceed the `time_budget` in seconds. The flow with the lowest cost including the
+    actual base fees is returned.
+
+    Only channels with a base fee above the threshold of the payment and up to `max_base_fee` msat get a
+    surcharge. The channels below the threshold are priced as before. Note that the `UncertaintyNetwork`
+    has to be created with a `base_threshold` of at least `max_base_fee` to contain the channels at all
+    (the payment sessions raise otherwise).
+    """
+
+    def __init__(self, max_base_fee: int = DEFAULT_MAX_BASE_FEE, max_iterations: int = DEFAULT_MAX_ITERATIONS,
+                 time_budget: float = DEFAULT_TIME_BUDGET):
+        if max_iterations < 1:
+            raise ValueError("the fixed charge approximation needs at least one iteration")
+        self._max_base_fee = max_base_fee
+        self._max_iterations = max_iterations
+        self._time_budget = time_budget
+
+    @property
+    def max_base_fee(self):
+        return self._max_base_fee
+
+    @property
+    def max_iterations(self):
+        return self._max_iterations
+
+    @property
+    def time_budget(self):
+        return self._time_budget
+
+    @staticmethod
+    def initial_estimates(capacities, amt: int):
+        """
+        the amount every channel is expected to carry given its capacity in the model
+        """
+        return np.maximum(np.minimum(capacities, int(amt)), 1)
+
+    @staticmethod
+    def unit_surcharges(base_fees, estimates):
+        """
+        the base fee (in msat) of every channel spread over its expected amount (in sat) as an increase of its
+        ppm, rounded up. Multiplied by `mu` it is added to the unit cost of the pieces of the channel.
+        """
+        return -(-1000 * base_fees // np.maximum(estimates, 1))
+
+    @staticmethod
+    def next_estimates(channel_flows, estimates):
+        """
+        the expected amounts for the next iteration: the flow of every used channel
+        """
+        return np.where(channel_flows > 0, channel_flows, estimates)
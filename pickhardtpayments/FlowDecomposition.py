@@ -0,0 +1,214 @@
+from enum import Enum
+from heapq import heappush, heappop
+from math import log2 as log
+from typing import List, Tuple
+
+import numpy as np
+
+
+class DecompositionPolicy(Enum):
+    """
+    Describes in which order the paths are peeled off a flow by the `FlowDecomposition`
+
+    SHORTEST: paths with the fewest hops first (the behaviour of the former networkx implementation)
+    WIDEST: paths with the largest bottleneck first, which tends to produce few but large onions
+    PROBABLE: paths with the highest success probability of their channels first
+    """
+    SHORTEST = 1
+    WIDEST = 2
+    PROBABLE = 4
+
+
+class FlowDecomposition:
+    """
+    Dissects an integer s-t flow into paths.
+
+    The flow is given by integer arrays over its edges (usually one edge per channel, i.e. the flow of all
+    piecewise linearized arcs of a channel is summed up). Every extracted path saturates at least one edge,
+    so at most as many paths as edges are extracted and every extraction only looks at the edges of the
+    flow which are a tiny fraction of the channel graph.
+
+    FIXME: Note that this dissection while accurate is probably not optimal in practice.
+    As noted in our Probabilistic payment delivery paper the payment process is a bernoulli trial
+    and I assume it makes sense to dissect the flow into paths of similar likelihood to make most
+    progress but this is a mere conjecture at this point. The `DecompositionPolicy` allows to experiment
+    with this.
+    """
+
+    def __init__(self, tails, heads, flows, channels=None, probabilities=None, cltv_deltas=None):
+        """
+        `tails`, `heads` and `flows` are arrays over the edges. `channels` optionally holds the channel index
+        (e.g. the row in the `ChannelTable`) of every edge which is used to describe the paths; otherwise
+        paths are described by the edge indices. `probabilities` optionally holds the success probability of
+        every edge to forward its flow and is needed for `DecompositionPolicy.PROBABLE`. `cltv_deltas`
+        optionally holds the `cltv_delta` of every edge and is needed to bound the CLTV of the paths.
+        """
+        self._channels = np.arange(len(tails)) if channels is None else np.asarray(channels)
+        self._tails = np.asarray(tails).tolist()
+        self._heads = np.asarray(heads).tolist()
+        self._remaining = np.asarray(flows).tolist()
+        self._out_edges = {}
+        for edge, tail in enumerate(self._tails):
+            if self._remaining[edge] > 0:
+                self._out_edges.setdefault(tail, []).append(edge)
+        self._weights = None
+        if probabilities is not None:
+            self._weights = [-log(p) if p > 0 else float("inf") for p in np.asarray(probabilities).tolist()]
+        self._cltv_deltas = None if cltv_deltas is None else np.asarray(cltv_deltas).tolist()
+
+    def _live_out_edges(self, node):
+        edges = self._out_edges.get(node)
+        if edges is None:
+            return []
+        # drop saturated edges so that later searches do not have to look at them again
+        if any(self._remaining[edge] == 0 for edge in edges):
+            edges[:] = [edge for edge in edges if self._remaining[edge] > 0]
+        return edges
+
+    def _backtrack(self, parent_edge, src, dest):
+        path = []
+        node = dest
+        while node != src:
+            edge = parent_edge[node]
+            path.append(edge)
+            node = self._tails[edge]
+        path.reverse()
+        return path
+
+    def _shortest_path(self, src, dest):
+        parent_edge = {src: None}
+        frontier = [src]
+        while frontier and dest not in parent_edge:
+            next_frontier = []
+            for node in frontier:
+                for edge in self._live_out_edges(node):
+                    head = self._heads[edge]
+                    if head not in parent_edge:
+                        parent_edge[head] = edge
+                        next_frontier.append(head)
+            frontier = next_frontier
+        if dest not in parent_edge:
+            return None
+        return self._backtrack(parent_edge, src, dest)
+
+    def _best_path(self, src, dest, widest: bool):
+        """
+        Dijkstra either maximizing the bottleneck (`widest`) or minimizing the sum of -log(probability)
+        """
+        best = {src: 0 if not widest else -float("inf")}
+        parent_edge = {src: None}
+        done = set()
+        heap = [(best[src], src)]
+        while heap:
+            key, node = heappop(heap)
+            if node in done:
+                continue
+            done.add(node)
+            if node == dest:
+                return self._backtrack(parent_edge, src, dest)
+            for edge in self._live_out_edges(node):
+                head = self._heads[edge]
+                if head in done:
+                    continue
+                if widest:
+                    # keys are negative widths so that the heap pops the widest path first
+                    candidate = max(key, -self._remaining[edge])
+                else:
+                    candidate = key + self._weights[edge]
+                if head not in best or candidate < best[head]:
+                    best[head] = candidate
+                    parent_edge[head] = edge
+                    heappush(heap, (candidate, head))
+        return None
+
+    def _cltv(self, path):
+        """
+        the CLTV that a path locks up: every hop charges the `cltv_delta` of the channel it forwards to, so
+        the first channel (the one of the sender) is free
+        """
+        return sum(self._cltv_deltas[edge] for edge in path[1:])
+
+    def _within_bounds(self, path, max_hops, max_cltv):
+        if max_hops is not None and len(path) > max_hops:
+            return False
+        return max_cltv is None or self._cltv(path) <= max_cltv
+
+    def _bounded_path(self, src, dest, max_hops, max_cltv):
+        """
+        finds the path with the fewest hops among those with at most `max_hops` hops and a CLTV of at most
+        `max_cltv` (either may be None) or returns None
+
+        The edges are relaxed layer by layer keeping the smallest CLTV with which every node is reached
+        with exactly that many hops. As the CLTV deltas are non negative, a walk with a cycle is never
+        found before the path that skips the cycle, so the first layer in which `dest` meets the CLTV
+        bound yields a simple path.
+        """
+        if max_hops is None:
+            # a simple path never has more hops than there are edges with flow
+            max_hops = len(self._tails)
+        cltv = {src: 0}
+        parents = []
+        for _ in range(max_hops):
+            next_cltv, parent_edge = {}, {}
+            for node, node_cltv in cltv.items():
+                for edge in self._live_out_edges(node):
+                    head = self._heads[edge]
+                    if head == src:
+                        continue
+                    candidate = node_cltv
+                    if node != src and self._cltv_deltas is not None:
+                        candidate += self._cltv_deltas[edge]
+                    if max_cltv is not None and candidate > max_cltv:
+                        continue
+                    if head not in next_cltv or candidate < next_cltv[head]:
+                        next_cltv[head] = candidate
+                        parent_edge[head] = edge
+            if not next_cltv:
+                return None
+            parents.append(parent_edge)
+            if dest in next_cltv:
+                path = []
+                node = dest
+                for layer in reversed(parents):
+                    edge = layer[node]
+                    path.append(edge)
+                    node = self._tails[edge]
+                path.reverse()
+                return path
+            cltv = next_cltv
+        return None
+
+    def paths(self, src, dest, policy: DecompositionPolicy = DecompositionPolicy.SHORTEST, max_hops: int = None,
+              max_cltv: int = None) -> List[Tuple[np.ndarray, int]]:
+        """
+        peels paths from `src` to `dest` off the flow in the order given by `policy`
+
+        returns a list of tuples consisting of the array of channel indices of a path and the amount (its
+        bottleneck) sent along it. Flow on cycles that do not contribute to the s-t flow remains unassigned.
+
+        With `max_hops` or `max_cltv` no path is returned that has more hops or locks up a larger CLTV
+        (see `_cltv`) than nodes would accept. If the path that the policy prefers violates a bound, the
+        path with the fewest hops that meets both is peeled off instead. Flow that can only be decomposed
+        into paths violating the bounds remains unassigned as well.
+        """
+        if policy == DecompositionPolicy.PROBABLE and self._weights is None:
+            raise ValueError("the PROBABLE policy needs the success probabilities of the edges")
+        if max_cltv is not None and self._cltv_deltas is None:
+            raise ValueError("bounding the CLTV of the paths needs the cltv deltas of the edges")
+        paths = []
+        while src != dest:
+            if policy == DecompositionPolicy.SHORTEST:
+                path = self._shortest_path(src, dest)
+            else:
+                path = self._best_path(src, dest, policy == DecompositionPolicy.WIDEST)
+            if path is None:
+                break
+            if not self._within_bounds(path, max_hops, max_cltv):
+                path = self._bounded_path(src, dest, max_hops, max_cltv)
+                if path is None:
+                    break
+            bottleneck = min(self._remaining[edge] for edge in path)
+            for edge in path:
+                self._remaining[edge] -= bottleneck
+            paths.append((self._channels[path], bottleneck))
+        return paths
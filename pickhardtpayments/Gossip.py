@@ -0,0 +1,69 @@
+from enum import Enum
+
+from .Channel import Channel
+
+
+class GossipEventType(Enum):
+    ADD = 1
+    UPDATE = 2
+    REMOVE = 4
+
+
+class GossipEvent:
+    """
+    A change of the public channel graph as it is learnt from gossip.
+
+    `ADD` announces a new channel direction and `UPDATE` carries the latest `channel_update` (fees, htlc
+    limits, ...) of a known one. Both carry the complete `Channel`. An update of an unknown channel is
+    treated as an announcement. `REMOVE` closes a channel direction which is identified by its
+    short_channel_id and direction (see `Channel.direction`).
+    """
+
+    def __init__(self, event_type: GossipEventType, channel: Channel = None, short_channel_id: str = None,
+                 direction: int = None):
+        if event_type == GossipEventType.REMOVE:
+            if channel is not None:
+                short_channel_id, direction = channel.short_channel_id, channel.direction
+            if short_channel_id is None or direction is None:
+                raise ValueError("a removal needs the short_channel_id and the direction of the channel")
+        elif channel is None:
+            raise ValueError("an announcement or update needs the channel")
+        self._event_type = event_type
+        self._channel = channel
+        self._short_channel_id = short_channel_id if channel is None else channel.short_channel_id
+        self._direction = direction if channel is None else channel.direction
+
+    @classmethod
+    def add(cls, channel: Channel):
+        return cls(GossipEventType.ADD, channel)
+
+    @classmethod
+    def update(cls, channel: Channel):
+        return cls(GossipEventType.UPDATE, channel)
+
+    @classmethod
+    def remove(cls, short_channel_id: str, direction: int):
+        return cls(GossipEventType.REMOVE, short_channel_id=short_channel_id, direction=direction)
+
+    @property
+    def event_type(self):
+        return self._event_type
+
+    @property
+    def channel(self):
+        return self._channel
+
+    @property
+    def short_channel_id(self):
+        return self._short_channel_id
+
+    @property
+    def direction(self):
+        return self._direction
+
+    @property
+    def key(self):
+        """
+        the `(short_channel_id, direction)` of the channel the event refers to
+        """
+        return self._short_channel_id, self._direction
@@ -0,0 +1,248 @@
+from collections import deque
+from heapq import heappush, heappop
+
+import numpy as np
+
+from .MinCostFlowSolver import MinCostFlowSolver
+
+INFINITE_DISTANCE = 2 ** 62
+# beyond this many shortest paths the OR-lib solves faster from scratch
+DEFAULT_MAX_AUGMENTATIONS = 8
+
+
+class IncrementalMinCostFlow:
+    """
+    Solves a sequence of min cost flow problems on a fixed set of arcs and warm starts every solve from the
+    optimal flow and node potentials of the previous one.
+
+    Between the rounds of a payment only the capacities and costs of the arcs of channels on failed or
+    arrived onions change and the amount to deliver shrinks. Instead of solving from scratch the previous
+    flow is repaired:
+
+    1. the flow is clipped to the new capacities
+    2. every arc whose reduced cost (with respect to the previous potentials) became negative is saturated
+       and every arc whose reduced cost became positive is emptied. Afterwards the residual graph has no
+       negative reduced cost arcs and thus no negative cycles.
+    3. the resulting excesses and deficits (including the changed supply) are removed with successive
+       shortest paths on the nonnegative reduced costs, which keeps the flow optimal.
+
+    Only arcs around the changed channels violate optimality, so usually very few augmentations are needed.
+    As the reduced costs are nonnegative every shortest path is found with Dijkstra, which stops at the
+    nearest deficit and thus only visits the neighbourhood of the changed channels. If the repair needs
+    more than `max_augmentations` of them the solve falls back to the OR-lib (compare the two with
+    `--warm-start` of `benchmarks/benchmark.py`). The first solve (or any solve after `reset`) is delegated
+    to the OR-lib. The potentials of its optimal flow are only derived (with a label correcting search from
+    the reverse arcs of the flow) once a warm start asks for them, so a payment that is done after one round
+    does not pay for them.
+    """
+
+    def __init__(self, tails, heads, number_of_nodes: int, max_augmentations: int = DEFAULT_MAX_AUGMENTATIONS):
+        if max_augmentations < 0:
+            raise ValueError("the number of augmentations of a warm start cannot be negative")
+        self._tails = np.asarray(tails, dtype=np.int64)
+        self._heads = np.asarray(heads, dtype=np.int64)
+        self._number_of_nodes = number_of_nodes
+        self._max_augmentations = max_augmentations
+        self._residual_tails = np.concatenate([self._tails, self._heads])
+        self._residual_heads = np.concatenate([self._heads, self._tails])
+        # the residual arcs leaving every node in compressed sparse row form as in `Topology`
+        arcs = np.argsort(self._residual_tails, kind="stable")
+        offsets = np.zeros(number_of_nodes + 1, dtype=np.int64)
+        offsets[1:] = np.cumsum(np.bincount(self._residual_tails, minlength=number_of_nodes))
+        self._out_offsets = offsets.tolist()
+        self._out_arcs = arcs.tolist()
+        self._residual_heads_list = self._residual_heads.tolist()
+        self._residual_tails_list = self._residual_tails.tolist()
+        self.reset()
+
+    def reset(self):
+        """
+        forgets the previous flow so that the next solve starts from scratch
+        """
+        self._flow = None
+        self._potential = None
+        self._cold_arcs = None
+
+    @property
+    def flow(self):
+        return self._flow
+
+    @property
+    def potential(self):
+        if self._potential is None and self._cold_arcs is not None:
+            self._potential = self._derive_potentials(*self._cold_arcs)
+            self._cold_arcs = None
+        return self._potential
+
+    def restore(self, flow, potential):
+        """
+        continues from a `flow` and its node `potentials` that an earlier solve on the same arcs found
+        """
+        self._flow = np.array(flow, dtype=np.int64)
+        self._potential = np.array(potential, dtype=np.int64)
+        self._cold_arcs = None
+
+    def _residual(self, capacities, flow):
+        return np.concatenate([capacities - flow, flow])
+
+    def _derive_potentials(self, capacities, costs):
+        """
+        potentials of an optimal flow are the distances from a virtual source in its residual graph
+
+        starting all nodes at distance 0 only the tails of negative residual arcs (the reverse arcs of the flow)
+        can improve a distance, so a label correcting search from them only visits the neighbourhood of the flow
+        """
+        residual = self._residual(capacities, self._flow)
+        weights = np.concatenate([costs, -costs])
+        negative = np.flatnonzero((residual > 0) & (weights < 0))
+        residual, weights = residual.tolist(), weights.tolist()
+        offsets, out_arcs, heads = self._out_offsets, self._out_arcs, self._residual_heads_list
+        distance = [0] * self._number_of_nodes
+        queue = deque(sorted(set(self._residual_tails[negative].tolist())))
+        queued = set(queue)
+        while queue:
+            node = queue.popleft()
+            queued.discard(node)
+            for arc in out_arcs[offsets[node]:offsets[node + 1]]:
+                if residual[arc] <= 0:
+                    continue
+                head = heads[arc]
+                candidate = distance[node] + weights[arc]
+                if candidate < distance[head]:
+                    distance[head] = candidate
+                    if head not in queued:
+                        queued.add(head)
+                        queue.append(head)
+        return np.array(distance, dtype=np.int64)
+
+    def _cold_solve(self, capacities, costs, supply):
+        solver = MinCostFlowSolver()
+        arcs = np.flatnonzero(capacities > 0)
+        solver.add_arcs(self._tails[arcs], self._heads[arcs], capacities[arcs], costs[arcs])
+        nodes = np.flatnonzero(supply)
+        solver.set_supplies(nodes, supply[nodes])
+        status = solver.solve()
+        if status != solver.OPTIMAL:
+            self.reset()
+            return False
+        self._flow = np.zeros(len(self._tails), dtype=np.int64)
+        self._flow[arcs] = solver.flows()
+        # the potentials are derived when the next warm start needs them (see `potential`)
+        self._potential = None
+        self._cold_arcs = (capacities, costs)
+        return True
+
+    def _augment(self, capacities, costs, excess):
+        """
+        removes all excesses with successive shortest paths on nonnegative reduced costs
+
+        returns False if the excesses cannot be removed or not within `max_augmentations`
+        """
+        number_of_arcs = len(self._tails)
+        offsets, out_arcs = self._out_offsets, self._out_arcs
+        tails, heads = self._residual_tails_list, self._residual_heads_list
+        residual = self._residual(capacities, self._flow).tolist()
+        weights = np.concatenate([costs, -costs]).tolist()
+        potential = self._potential.tolist()
+        excess = excess.tolist()
+        surplus = {node for node, amount in enumerate(excess) if amount > 0}
+        deficit = {node for node, amount in enumerate(excess) if amount < 0}
+
+        augmentations = 0
+        successful = True
+        while surplus:
+            if augmentations == self._max_augmentations:
+                successful = False
+                break
+            augmentations += 1
+
+            # Dijkstra from all excesses to the nearest deficit
+            distance = dict.fromkeys(surplus, 0)
+            predecessor = {}
+            done = []
+            settled = set()
+            heap = [(0, node) for node in surplus]
+            target = None
+            while heap:
+                d, node = heappop(heap)
+                if node in settled:
+                    continue
+                settled.add(node)
+                done.append(node)
+                if node in deficit:
+                    target = node
+                    break
+                reduced = d + potential[node]
+                for arc in out_arcs[offsets[node]:offsets[node + 1]]:
+                    if residual[arc] <= 0:
+                        continue
+                    head = heads[arc]
+                    if head in settled:
+                        continue
+                    candidate = reduced + weights[arc] - potential[head]
+                    if candidate < distance.get(head, INFINITE_DISTANCE):
+                        distance[head] = candidate
+                        predecessor[head] = arc
+                        heappush(heap, (candidate, head))
+            if target is None:
+                successful = False
+                break
+
+            # keep reduced costs nonnegative for the next search. Nodes that were not settled are at least as
+            # far as the target, so shifting only the settled ones is the same up to a constant
+            target_distance = distance[target]
+            for node in done:
+                potential[node] += distance[node] - target_distance
+
+            path = []
+            node = target
+            while node in predecessor:
+                arc = predecessor[node]
+                path.append(arc)
+                node = tails[arc]
+            source = node
+            amount = min(min(residual[arc] for arc in path), excess[source], -excess[target])
+            for arc in path:
+                residual[arc] -= amount
+                residual[arc + number_of_arcs if arc < number_of_arcs else arc - number_of_arcs] += amount
+            excess[source] -= amount
+            excess[target] += amount
+            if excess[source] == 0:
+                surplus.discard(source)
+            if excess[target] == 0:
+                deficit.discard(target)
+
+        # the residual capacity of a reverse arc is the flow on its arc
+        self._flow = np.array(residual[number_of_arcs:], dtype=np.int64)
+        self._potential = np.array(potential, dtype=np.int64)
+        return successful
+
+    def solve(self, capacities, costs, src: int, dest: int, amt: int):
+        """
+        computes the min cost flow sending `amt` from node `src` to node `dest`
+
+        returns True if an optimal flow was found which can be read from `flow`
+        """
+        capacities = np.asarray(capacities, dtype=np.int64)
+        costs = np.asarray(costs, dtype=np.int64)
+        supply = np.zeros(self._number_of_nodes, dtype=np.int64)
+        supply[src] += amt
+        supply[dest] -= amt
+        if self._flow is None:
+            return self._cold_solve(capacities, costs, supply)
+
+        potential = self.potential
+        flow = np.minimum(self._flow, capacities)
+        reduced_costs = costs + potential[self._tails] - potential[self._heads]
+        saturated = reduced_costs < 0
+        flow[saturated] = capacities[saturated]
+        flow[reduced_costs > 0] = 0
+        self._flow = flow
+
+        excess = supply.copy()
+        np.add.at(excess, self._tails, -flow)
+        np.add.at(excess, self._heads, flow)
+        if not self._augment(capacities, costs, excess):
+            # the repair did not converge to a feasible flow (or took too long), so we try again from scratch
+            return self._cold_solve(capacities, costs, supply)
+        return True
@@ -0,0 +1,172 @@
+"""
+Linearization.py
+====================================
+Vectorized kernels to compute the piecewise linearized costs of many channels at once.
+
+The kernels operate on plain numpy arrays that describe our belief about the liquidity of the
+channels (as stored in the `ChannelTable`) and produce exactly the same pieces as the scalar
+`UncertaintyChannel.get_piecewise_linearized_costs` does for every single channel. All computations
+are element wise passes over contiguous int64 arrays without python loops over the channels.
+
+`adaptive_piecewise_linearized_costs` is an alternative to the uniform pieces which places the
+breakpoints such that the approximation error of the uncertainty cost stays bounded.
+"""
+
+from functools import lru_cache
+from math import log, log2
+
+import numpy as np
+
+MAX_CHANNEL_SIZE = 15_000_000_000  # 150 BTC
+
+# maximal error in bits of the linearized uncertainty cost of a piece
+DEFAULT_MAX_ERROR = 0.1
+
+
+def piecewise_linearized_costs(min_liquidity, max_liquidity, in_flight, ppm, mu: int, number_of_pieces: int):
+    """
+    computes the pieces of all channels described by the given arrays
+
+    returns three arrays `capacities`, `costs` of shape (number of channels, number_of_pieces) and `used`
+    with the number of pieces of every channel. The pieces of a channel are stored in its first `used`
+    columns in the same order as the scalar method returns them. Unused columns have zero capacity and cost.
+    """
+    routing_unit_cost = mu * ppm
+
+    # using certainly available liquidity costs us nothing but fees
+    certain_capacity = min_liquidity - in_flight
+    has_certain_piece = certain_capacity > 0
+    offset = has_certain_piece.astype(np.int64)
+    uncertain_pieces = number_of_pieces - offset
+
+    conditional_capacity = np.maximum(max_liquidity - np.maximum(min_liquidity, in_flight), 0)
+    has_uncertain_pieces = (conditional_capacity > 0) & (uncertain_pieces > 0)
+    # float divisions and truncation mirror the scalar implementation exactly
+    arc_capacity = (conditional_capacity / np.maximum(uncertain_pieces, 1)).astype(np.int64)
+    uncertainty_unit_cost = (MAX_CHANNEL_SIZE / np.maximum(conditional_capacity, 1)).astype(np.int64)
+
+    columns = np.arange(number_of_pieces)
+    uncertain = has_uncertain_pieces[:, None] & (columns[None, :] >= offset[:, None])
+    multiples = columns[None, :] - offset[:, None] + 1
+    capacities = np.where(uncertain, arc_capacity[:, None], 0)
+    costs = np.where(uncertain, multiples * uncertainty_unit_cost[:, None] + routing_unit_cost[:, None], 0)
+
+    capacities[:, 0] = np.where(has_certain_piece, certain_capacity, capacities[:, 0])
+    costs[:, 0] = np.where(has_certain_piece, routing_unit_cost, costs[:, 0])
+
+    used = offset + np.where(has_uncertain_pieces, uncertain_pieces, 0)
+    return capacities, costs, used
+
+
+def flatten_pieces(capacities, costs, used):
+    """
+    turns the (channels x pieces) matrices of `piecewise_linearized_costs` into flat arrays of arcs
+
+    returns `owner` (the index of the channel every arc belongs to), `capacities` and `costs`. The arcs are
+    ordered by channel and within a channel by piece.
+    """
+    in_use = np.arange(capacities.shape[1])[None, :] < used[:, None]
+    owner = np.repeat(np.arange(len(used)), used)
+    return owner, capacities[in_use], costs[in_use]
+
+
+def piecewise_linearized_arcs(src, dest, min_liquidity, max_liquidity, in_flight, ppm, mu: int,
+                              number_of_pieces: int):
+    """
+    computes all arcs of the piecewise linearized min cost flow problem in one call
+
+    returns the flat arrays `owner`, `tails`, `heads`, `capacities` and `costs` that can be handed to the
+    min cost flow solver directly. `owner` is the index of the channel in the input arrays every arc
+    belongs to.
+    """
+    capacities, costs, used = piecewise_linearized_costs(min_liquidity, max_liquidity, in_flight, ppm, mu,
+                                                         number_of_pieces)
+    owner, capacities, costs = flatten_pieces(capacities, costs, used)
+    return owner, src[owner], dest[owner], capacities, costs
+
+
+def _chord_error(ratio: float):
+    """
+    the maximal error in bits of the chord of -log2(u) over [ratio, 1]
+    """
+    # the chord is steepest relative to -log2(u) where both have the same slope
+    u = (1 - ratio) / -log(ratio)
+    return -log2(ratio) * (1 - u) / (1 - ratio) + log2(u)
+
+
+@lru_cache(maxsize=None)
+def piece_ratio(max_error: float):
+    """
+    the largest ratio of the remaining conditional capacity after and before a piece for which the error
+    of the linearized uncertainty cost stays below `max_error` bits
+
+    The uncertainty cost -log2((c + 1 - x) / (c + 1)) is scale invariant in the remaining capacity
+    c + 1 - x, so the same ratio bounds the error of every piece of every channel.
+    """
+    low, high = 1e-12, 1 - 1e-12
+    for _ in range(100):
+        ratio = (low + high) / 2
+        if _chord_error(ratio) > max_error:
+            low = ratio
+        else:
+            high = ratio
+    return high
+
+
+def adaptive_piecewise_linearized_costs(min_liquidity, max_liquidity, in_flight, ppm, mu: int, amt: int,
+                                        max_error: float = DEFAULT_MAX_ERROR, max_pieces: int = 5):
+    """
+    computes non uniform pieces of all channels described by the given arrays
+
+    Every piece of the uncertain liquidity of a channel with conditional capacity c ends where the
+    remaining capacity c + 1 - x has shrunk by the factor `r = piece_ratio(max_error)` or where the liquidity
+    that the payment can use ends, so every piece approximates the uncertainty cost up to `max_error` bits
+    and no piece reaches beyond `amt` (together with the certain piece). A channel whose cost is almost
+    linear up to `amt` thus gets a single piece. Like the uniform pieces a channel has at most `max_pieces`
+    pieces including the certain one. Liquidity beyond the last piece is not offered to the solver: it is
+    the last fraction `r ** pieces` of the support, which forwards the payment with a probability of at
+    most that fraction. The unit cost of a piece is the slope of the chord of the uncertainty cost (in the
+    scale of `MAX_CHANNEL_SIZE`) plus the routing cost.
+
+    returns `capacities`, `costs` of shape (number of channels, max_pieces) and `used` with the same layout
+    as `piecewise_linearized_costs`, so no channel uses more pieces than with the uniform linearization. The
+    first piece is the certain liquidity if there is any.
+    """
+    routing_unit_cost = mu * ppm
+    number_of_channels = len(min_liquidity)
+
+    # using certainly available liquidity costs us nothing but fees
+    certain_capacity = np.minimum(min_liquidity - in_flight, amt)
+    has_certain_piece = certain_capacity > 0
+    offset = has_certain_piece.astype(np.int64)
+
+    conditional_capacity = np.maximum(max_liquidity - np.maximum(min_liquidity, in_flight), 0)
+    limit = np.minimum(conditional_capacity, amt - np.maximum(certain_capacity, 0))
+    support = conditional_capacity + 1
+    ratio = piece_ratio(max_error)
+
+    capacities = np.zeros((number_of_channels, max_pieces), dtype=np.int64)
+    costs = np.zeros((number_of_channels, max_pieces), dtype=np.int64)
+    capacities[:, 0] = np.where(has_certain_piece, certain_capacity, 0)
+    costs[:, 0] = np.where(has_certain_piece, routing_unit_cost, 0)
+
+    start = np.zeros(number_of_channels, dtype=np.int64)
+    pieces = np.zeros(number_of_channels, dtype=np.int64)
+    for piece in range(max_pieces):
+        # the uncertain pieces follow the certain piece if there is one
+        active = (start < limit) & (piece + offset < max_pieces)
+        end = np.floor(support - (support - start) * ratio).astype(np.int64)
+        end = np.minimum(np.maximum(end, start + 1), limit)
+        width = np.where(active, end - start, 0)
+        with np.errstate(divide="ignore", invalid="ignore"):
+            slope = np.log((support - start) / (support - end)) / np.maximum(width, 1)
+        cost = np.where(active, (MAX_CHANNEL_SIZE * slope).astype(np.int64) + routing_unit_cost, 0)
+        column = np.minimum(piece + offset, max_pieces - 1)
+        rows = np.flatnonzero(active)
+        capacities[rows, column[rows]] = width[rows]
+        costs[rows, column[rows]] = cost[rows]
+        pieces += active
+        start = np.where(active, end, start)
+
+    used = offset + pieces
+    return capacities, costs, used
@@ -0,0 +1,70 @@
+import numpy as np
+
+try:
+    # the vectorized pybind11 API of the OR-lib (ortools >= 9.4)
+    from ortools.graph.python import max_flow
+except ImportError:
+    max_flow = None
+    from ortools.graph import pywrapgraph
+
+
+class MaxFlowSolver:
+    """
+    A thin wrapper around the `SimpleMaxFlow` solver of the Google OR-lib that moves whole numpy arrays
+    across the python / C++ boundary.
+
+    The arcs are added once and the solver can be solved repeatedly for different sources and sinks
+    after the capacities of some arcs have been changed via `set_capacities`. As for the
+    `MinCostFlowSolver` older versions of ortools fall back to the per arc SWIG API of `pywrapgraph`.
+    """
+
+    def __init__(self):
+        if max_flow is not None:
+            self._solver = max_flow.SimpleMaxFlow()
+        else:
+            self._solver = pywrapgraph.SimpleMaxFlow()
+        self._num_arcs = 0
+
+    @property
+    def OPTIMAL(self):
+        return self._solver.OPTIMAL
+
+    @property
+    def num_arcs(self):
+        return self._num_arcs
+
+    def add_arcs(self, tails, heads, capacities):
+        """
+        adds all arcs given by the int64 arrays in one call and returns the arc indices
+        """
+        if max_flow is not None:
+            arcs = self._solver.add_arcs_with_capacity(
+                np.ascontiguousarray(tails, dtype=np.int64), np.ascontiguousarray(heads, dtype=np.int64),
+                np.ascontiguousarray(capacities, dtype=np.int64))
+        else:
+            arcs = np.array([self._solver.AddArcWithCapacity(tail, head, capacity)
+                             for tail, head, capacity in zip(np.asarray(tails).tolist(), np.asarray(heads).tolist(),
+                                                             np.asarray(capacities).tolist())],
+                            dtype=np.int64)
+        self._num_arcs += len(arcs)
+        return np.asarray(arcs, dtype=np.int64)
+
+    def set_capacities(self, arcs, capacities):
+        """
+        changes the capacity of the given arcs for the next call to `solve`
+        """
+        if max_flow is not None:
+            self._solver.set_arcs_capacity(np.asarray(arcs, dtype=np.int64), np.asarray(capacities, dtype=np.int64))
+        else:
+            for arc, capacity in zip(np.asarray(arcs).tolist(), np.asarray(capacities).tolist()):
+                self._solver.SetArcCapacity(arc, capacity)
+
+    def solve(self, source: int, sink: int):
+        if max_flow is not None:
+            return self._solver.solve(source, sink)
+        return self._solver.Solve(source, sink)
+
+    def optimal_flow(self):
+        if max_flow is not None:
+            return self._solver.optimal_flow()
+        return self._solver.OptimalFlow()
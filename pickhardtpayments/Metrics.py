@@ -0,0 +1,154 @@
+"""
+Metrics.py
+====================================
+Counters and histograms which the payment sessions report to a pluggable sink.
+
+A sink only has to offer `increment` for counters and `observe` for histograms. The default
+`MetricsSink` discards everything, `InMemoryMetrics` aggregates the values and renders them in the
+Prometheus text exposition format. Adapters to an OpenTelemetry meter or a Prometheus client only have to
+forward the two calls.
+"""
+
+import time
+from bisect import bisect_left
+from contextlib import contextmanager
+
+# histograms (in seconds unless noted otherwise)
+SOLVER_BUILD_SECONDS = "solver_build_seconds"
+SOLVER_SOLVE_SECONDS = "solver_solve_seconds"
+DECOMPOSITION_SECONDS = "decomposition_seconds"
+ONION_ROUND_TRIP_SECONDS = "onion_round_trip_seconds"
+ATTEMPTS_PER_ROUND = "attempts_per_round"
+LEARNT_ENTROPY_BITS = "learnt_entropy_bits"
+
+# counters
+ROUNDS_TOTAL = "rounds_total"
+ATTEMPTS_TOTAL = "attempts_total"
+FAILED_ATTEMPTS_TOTAL = "failed_attempts_total"
+PAYMENTS_TOTAL = "payments_total"
+SUCCESSFUL_PAYMENTS_TOTAL = "successful_payments_total"
+PLAN_CACHE_HITS_TOTAL = "plan_cache_hits_total"
+PLAN_CACHE_WARM_STARTS_TOTAL = "plan_cache_warm_starts_total"
+INFEASIBLE_ROUNDS_TOTAL = "infeasible_rounds_total"
+
+DEFAULT_BUCKETS = (0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1., 5., 10., 50., 100.)
+COUNT_BUCKETS = (1, 2, 5, 10, 20, 50, 100)
+
+
+class MetricsSink:
+    """
+    A sink that discards all metrics
+    """
+
+    def increment(self, name: str, value: float = 1):
+        pass
+
+    def observe(self, name: str, value: float):
+        pass
+
+    @contextmanager
+    def timer(self, name: str):
+        """
+        observes the wall clock time of the block in the histogram `name`
+        """
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.observe(name, time.perf_counter() - start)
+
+
+class Histogram:
+    """
+    cumulative buckets, count and sum of the observed values
+    """
+
+    def __init__(self, buckets=DEFAULT_BUCKETS):
+        self._buckets = tuple(buckets)
+        self._counts = [0] * (len(self._buckets) + 1)
+        self._count = 0
+        self._sum = 0.
+
+    def observe(self, value: float):
+        self._counts[bisect_left(self._buckets, value)] += 1
+        self._count += 1
+        self._sum += value
+
+    @property
+    def count(self):
+        return self._count
+
+    @property
+    def sum(self):
+        return self._sum
+
+    def cumulative_buckets(self):
+        """
+        returns pairs of upper bound and the number of observations up to it (the last bound is inf)
+        """
+        total = 0
+        result = []
+        for bound, count in zip(self._buckets + (float("inf"),), self._counts):
+            total += count
+            result.append((bound, total))
+        return result
+
+
+class InMemoryMetrics(MetricsSink):
+    """
+    A sink that aggregates all metrics in the process
+
+    `buckets` optionally maps the name of a histogram to its bucket bounds.
+    """
+
+    def __init__(self, prefix: str = "pickhardt_", buckets: dict = None):
+        self._prefix = prefix
+        self._buckets = {ATTEMPTS_PER_ROUND: COUNT_BUCKETS, LEARNT_ENTROPY_BITS: COUNT_BUCKETS}
+        if buckets is not None:
+            self._buckets.update(buckets)
+        self._counters = {}
+        self._histograms = {}
+
+    def increment(self, name: str, value: float = 1):
+        self._counters[name] = self._counters.get(name, 0) + value
+
+    def observe(self, name: str, value: float):
+        histogram = self._histograms.get(name)
+        if histogram is None:
+            histogram = Histogram(self._buckets.get(name, DEFAULT_BUCKETS))
+            self._histograms[name] = histogram
+        histogram.observe(value)
+
+    def counter(self, name: str):
+        return self._counters.get(name, 0)
+
+    def histogram(self, name: str):
+        return self._histograms.get(name)
+
+    @property
+    def failure_rate(self):
+        """
+        the fraction of all attempts that failed (None if there were no attempts)
+        """
+        attempts = self.counter(ATTEMPTS_TOTAL)
+        if attempts == 0:
+            return None
+        return self.counter(FAILED_ATTEMPTS_TOTAL) / attempts
+
+    def prometheus_text(self):
+        """
+        renders all metrics in the Prometheus text exposition format
+        """
+        lines = []
+        for name, value in sorted(self._counters.items()):
+            lines.append("# TYPE {}{} counter".format(self._prefix, name))
+            lines.append("{}{} {}".format(self._prefix, name, value))
+        for name, histogram in sorted(self._histograms.items()):
+            metric = self._prefix + name
+            lines.append("# TYPE {} histogram".format(metric))
+            for bound, count in histogram.cumulative_buckets():
+                lines.append('{}_bucket{{le="{}"}} {}'.format(metric, "+Inf" if bound == float("inf") else bound,
+                                                             count))
+            lines.append("{}_sum {}".format(metric, histogram.sum))
+            lines.append("{}_count {}".format(metric, histogram.count))
+        return "\n".join(lines) + "\n"
@@ -0,0 +1,489 @@
+from .UncertaintyNetwork import UncertaintyNetwork
+from .UncertaintyChannel import DEFAULT_N
+from .Linearization import flatten_pieces
+from .MinCostFlowSolver import MinCostFlowSolver
+from .IncrementalMinCostFlow import IncrementalMinCostFlow
+from .Pruning import QuantilePruning
+from .FixedCharge import FixedChargeApproximation
+from .Subgraph import reachable_arcs, renumber_nodes
+
+from concurrent.futures import ThreadPoolExecutor
+import time
+import numpy as np
+
+DEFAULT_BASE_THRESHOLD = 0
+
+
+class MinCostFlowModel:
+    """
+    The MinCostFlowModel holds the piecewise linearized arcs of the UncertaintyNetwork across the rounds
+    of a payment session.
+
+    Computing the piecewise linearization of every channel takes longer on mainnet than solving the
+    min cost flow problem itself. Thus the arcs are only computed once per session and afterwards only
+    the arcs of channels whose `min_liquidity`, `max_liquidity` or `in_flight` changed since the previous
+    refresh (as reported by `ChannelTable.changed_rows_since` for the version of the table at that refresh)
+    are recomputed. A change of `mu` or of the `base_fee` threshold changes the cost of every arc and thus
+    triggers a full rebuild.
+
+    Every channel owns a fixed row of arc slots in the `_arc_capacities` and `_arc_costs` arrays. The
+    Google OR-lib min cost flow solver cannot change unit costs of existing arcs, so each round a fresh
+    solver is fed in bulk from the stored slots but only with the pieces that are actually in use.
+
+    Alternatively `solve_incremental` keeps all slots as a fixed set of arcs (unused pieces get a capacity
+    of zero) and repairs the optimal flow of the previous round with an `IncrementalMinCostFlow`.
+
+    With a `max_linearization_error` the pieces are not uniform but adaptive to the uncertainty cost and
+    to the amount of the payment (see `Linearization.adaptive_piecewise_linearized_costs`). As the amount
+    only decreases during a payment session the arcs are only rebuilt if a larger amount is requested.
+
+    Gossip that is applied to the UncertaintyNetwork (see `UncertaintyNetwork.apply_gossip`) does not force a
+    rebuild either: updated channels are flagged as changed like any other change of our belief, and the
+    slots are only moved if channels were announced or closed or crossed the base fee threshold.
+
+    With a `fixed_charge` approximation channels up to its `max_base_fee` get arc slots as well and
+    `solve_fixed_charge` prices their base fee (see `FixedChargeApproximation`).
+    """
+
+    def __init__(self, uncertainty_network: UncertaintyNetwork, prune_network: bool = True,
+                 number_of_pieces: int = DEFAULT_N, pruning: QuantilePruning = None, reachable_only: bool = False,
+                 max_hops: int = None, max_linearization_error: float = None,
+                 fixed_charge: FixedChargeApproximation = None):
+        """
+        If a `pruning` is given it decides per payment which channels are handed to the solver instead of
+        the fixed success probability filter of `prune_network`.
+
+        With `reachable_only` the solver only gets the channels that lie on a route from the sender to the
+        recipient (with at most `max_hops` hops if given) and works on a compact renumbered node space.
+        Note that a too small `max_hops` can make the problem infeasible.
+
+        If `max_linearization_error` (in bits) is given every channel gets up to `number_of_pieces` pieces
+        (including the piece of its certain liquidity) of adaptive width.
+
+        A `fixed_charge` approximation admits channels whose base fee is above the threshold of the
+        payment (see `solve_fixed_charge`).
+        """
+        self._uncertainty_network = uncertainty_network
+        self._channel_table = uncertainty_network.channel_table
+        self._prune_network = prune_network
+        self._pruning = pruning
+        self._reachable_only = reachable_only
+        self._max_hops = max_hops
+        self._number_of_pieces = number_of_pieces
+        self._max_linearization_error = max_linearization_error
+        self._fixed_charge = fixed_charge
+        self._mu = None
+        self._base_fee = None
+        self._amount = None
+        self._rows = np.zeros(0, dtype=np.int64)
+        self._position = np.zeros(0, dtype=np.int64)
+        self._arc_capacities = np.zeros((0, 0), dtype=np.int64)
+        self._arc_costs = np.zeros((0, 0), dtype=np.int64)
+        self._used_pieces = np.zeros(0, dtype=np.int64)
+        self._arc_rows = np.zeros(0, dtype=np.int64)
+        self._incremental = None
+        self._terminals = None
+        # counts the changes of the layout of the arc slots
+        self._layout = 0
+
+    @property
+    def number_of_channels(self):
+        return len(self._rows)
+
+    def _slots_per_channel(self):
+        if self._max_linearization_error is not None:
+            return self._number_of_pieces
+        # the pruned network never uses more than three pieces per channel
+        if self._prune_network:
+            return min(3, self._number_of_pieces)
+        return self._number_of_pieces
+
+    def _build(self, mu: int, base_fee: int, amt: int = None):
+        """
+        creates the arc slots for all channels that do not charge a base fee higher than `base_fee`
+        """
+        self._mu = mu
+        self._base_fee = base_fee
+        self._amount = amt
+        self._rows = self._eligible_rows()
+        self._position = np.full(len(self._channel_table), -1, dtype=np.int64)
+        self._position[self._rows] = np.arange(len(self._rows))
+
+        slots = self._slots_per_channel()
+        self._arc_capacities = np.zeros((len(self._rows), slots), dtype=np.int64)
+        self._arc_costs = np.zeros((len(self._rows), slots), dtype=np.int64)
+        self._used_pieces = np.zeros(len(self._rows), dtype=np.int64)
+        # the layout of the slots changed so a previous flow cannot be reused
+        self._incremental = None
+        self._layout += 1
+        # everything is computed from scratch so previous changes are obsolete
+        self._synced_version = self._channel_table.version
+        self._update_rows(self._rows)
+
+    def _eligible_rows(self):
+        """
+        the rows of all open channels that do not charge a base fee higher than the threshold (or than the
+        `max_base_fee` of the fixed charge approximation)
+        """
+        # ignore channels with too large base fee
+        threshold = self._base_fee
+        if self._fixed_charge is not None:
+            threshold = max(threshold, self._fixed_charge.max_base_fee)
+        return np.flatnonzero((self._channel_table.base_fee <= threshold) & ~self._channel_table.removed)
+
+    def _sync_rows(self):
+        """
+        moves the arc slots to the rows that are eligible after gossip was applied to the UncertaintyNetwork
+
+        The slots of channels that stay eligible are kept. Channels only become eligible through gossip
+        which flags their rows as changed, so their slots are filled by the following `_update_rows`.
+        """
+        rows = self._eligible_rows()
+        if len(rows) == len(self._rows) and np.array_equal(rows, self._rows):
+            return
+        old_position = np.full(len(self._channel_table), -1, dtype=np.int64)
+        old_position[:len(self._position)] = self._position
+        position = np.full(len(self._channel_table), -1, dtype=np.int64)
+        position[rows] = np.arange(len(rows))
+        kept = rows[old_position[rows] >= 0]
+
+        slots = self._slots_per_channel()
+        arc_capacities = np.zeros((len(rows), slots), dtype=np.int64)
+        arc_costs = np.zeros((len(rows), slots), dtype=np.int64)
+        used_pieces = np.zeros(len(rows), dtype=np.int64)
+        arc_capacities[position[kept]] = self._arc_capacities[old_position[kept]]
+        arc_costs[position[kept]] = self._arc_costs[old_position[kept]]
+        used_pieces[position[kept]] = self._used_pieces[old_position[kept]]
+        self._rows = rows
+        self._position = position
+        self._arc_capacities = arc_capacities
+        self._arc_costs = arc_costs
+        self._used_pieces = used_pieces
+        # the layout of the slots changed so a previous flow cannot be reused
+        self._incremental = None
+        self._layout += 1
+
+    def _update_rows(self, rows):
+        """
+        recomputes the piecewise linearized arcs of the given rows of the channel table in one vectorized pass
+        """
+        rows = rows[self._position[rows] >= 0]
+        if len(rows) == 0:
+            return
+        positions = self._position[rows]
+        slots = self._slots_per_channel()
+        # QUANTIZATION):
+        if self._max_linearization_error is not None:
+            capacities, costs, used = self._channel_table.get_adaptive_piecewise_linearized_costs(
+                rows, self._mu, self._amount, self._max_linearization_error, self._number_of_pieces)
+        else:
+            capacities, costs, used = self._channel_table.get_piecewise_linearized_costs(
+                rows, self._number_of_pieces, self._mu)
+        self._arc_capacities[positions] = capacities[:, :slots]
+        self._arc_costs[positions] = costs[:, :slots]
+        used = np.minimum(used, slots)
+
+        # FIXME: Remove Magic Number for pruning
+        # Prune channels away that have too low success probability! This is a huge runtime boost
+        # However the pruning would be much better to work on quantiles of normalized cost
+        # So as soon as we have better Scaling, Centralization and feature engineering we can
+        # probably have a more focused pruning (which `QuantilePruning` does)
+        if self._prune_network and self._pruning is None:
+            used[self._channel_table.success_probability(250_000, rows) < 0.9] = 0
+        self._used_pieces[positions] = used
+
+    def refresh(self, mu: int, base_fee: int = DEFAULT_BASE_THRESHOLD, amt: int = None):
+        """
+        brings the arcs up to date with our current belief about the liquidity in the UncertaintyNetwork
+
+        Only channels that changed (or whose belief decayed) since the last refresh are linearized again unless
+        `mu` or `base_fee` differ from the last call in which case all arcs are rebuilt. The adaptive linearization needs the
+        amount `amt` of the payment and is rebuilt if it exceeds the amount the arcs were computed for.
+        """
+        if self._max_linearization_error is not None:
+            if amt is None:
+                raise ValueError("the adaptive linearization needs the amount of the payment")
+            if self._amount is None or amt > self._amount:
+                self._build(mu, base_fee, int(amt))
+                return
+        if mu != self._mu or base_fee != self._base_fee:
+            self._build(mu, base_fee, self._amount)
+            return
+        # gossip might have changed which channels are eligible
+        self._sync_rows()
+        # our belief might have decayed since the last round
+        self._channel_table.decay(self._rows)
+        changed = self._channel_table.changed_rows_since(self._synced_version)
+        self._synced_version = self._channel_table.version
+        self._update_rows(changed)
+
+    def _pruned_pieces(self, src, dest, amt: int):
+        """
+        the number of pieces of every channel that are handed to the solver for the given payment
+        """
+        used = self._used_pieces
+        node_index = self._channel_table.node_index
+        if self._pruning is not None:
+            slots = self._slots_per_channel()
+            in_use = np.arange(slots)[None, :] < used[:, None]
+            capacities = np.where(in_use, self._arc_capacities, 0).sum(axis=1)
+            keep = self._pruning.keep(self._channel_table, self._rows, capacities, node_index[src],
+                                      node_index[dest], int(amt), self._mu)
+            used = np.where(keep, used, 0)
+        if self._reachable_only:
+            channels = np.flatnonzero(used > 0)
+            rows = self._rows[channels]
+            reachable = reachable_arcs(self._channel_table.src[rows], self._channel_table.dest[rows],
+                                       node_index[src], node_index[dest], self._channel_table.number_of_nodes,
+                                       self._max_hops)
+            used = used.copy()
+            used[channels[~reachable]] = 0
+        return used
+
+    def _solver_arcs(self, src, dest, amt: int):
+        """
+        the arcs that are handed to the solver for a payment together with the solver indices of `src` and
+        `dest`. Sets `arc_rows` accordingly.
+        """
+        owner, capacities, costs = flatten_pieces(self._arc_capacities, self._arc_costs,
+                                                  self._pruned_pieces(src, dest, amt))
+        self._arc_rows = self._rows[owner]
+        tails = self._channel_table.src[self._arc_rows]
+        heads = self._channel_table.dest[self._arc_rows]
+        node_index = self._channel_table.node_index
+        s, d = node_index[src], node_index[dest]
+        if self._reachable_only:
+            # the solver only needs to know the nodes of the reachable subgraph
+            tails, heads, s, d, _ = renumber_nodes(tails, heads, s, d)
+        return tails, heads, capacities, costs, s, d
+
+    def make_solver(self, src, dest, amt: int):
+        """
+        returns a `MinCostFlowSolver` which contains all used arcs of the model and the supply to send `amt`
+        from `src` to `dest`
+
+        All arcs are handed to the solver as arrays in one call and only the supplies of `src` and `dest`
+        are set, as all other nodes have a supply of zero anyway.
+        """
+        min_cost_flow = MinCostFlowSolver()
+        tails, heads, capacities, costs, s, d = self._solver_arcs(src, dest, amt)
+        min_cost_flow.add_arcs(tails, heads, capacities, costs)
+
+        # add amount to sending node and -amount to recipient node
+        min_cost_flow.set_supplies([s, d], [int(amt), -int(amt)])
+        return min_cost_flow
+
+    def solve_for_mus(self, src, dest, amt: int, mus, max_workers: int = None):
+        """
+        solves the problem to send `amt` from `src` to `dest` once for every value in `mus` on separate threads
+
+        All candidates share the arcs of the last `refresh` (tails, heads and capacities are read only). As
+        the unit cost of every piece is its uncertainty cost plus `mu * ppm`, only the routing part of the
+        costs is shifted per candidate, so the arcs are not linearized again. Note that a `pruning` decides
+        on the channels with the `mu` of the last `refresh` for all candidates.
+
+        Returns the flow on all arcs given by `arc_rows` (None if infeasible) for every value of `mus`.
+        """
+        tails, heads, capacities, costs, s, d = self._solver_arcs(src, dest, amt)
+        ppm = self._channel_table.ppm[self._arc_rows]
+
+        def solve(mu):
+            solver = MinCostFlowSolver()
+            solver.add_arcs(tails, heads, capacities, costs + (int(mu) - self._mu) * ppm)
+            solver.set_supplies([s, d], [int(amt), -int(amt)])
+            if solver.solve() != solver.OPTIMAL:
+                return None
+            return solver.flows()
+
+        with ThreadPoolExecutor(max_workers=max_workers or len(mus)) as executor:
+            return list(executor.map(solve, mus))
+
+    def solve_fixed_charge(self, src, dest, amt: int):
+        """
+        computes the min cost flow to send `amt` from `src` to `dest` with the base fees of the channels above
+        the threshold approximated by surcharges on their unit costs (see `FixedChargeApproximation`)
+
+        Every iteration solves the problem on the arcs of the last `refresh` with the costs shifted by
+        `mu` times the surcharges. Returns the flow on all arcs given by `arc_rows` that has the lowest
+        linearized cost plus `mu` times the base fees of its charged channels, or None if the problem is
+        infeasible.
+        """
+        approximation = self._fixed_charge
+        if approximation is None:
+            raise ValueError("the model has no fixed charge approximation")
+        start = time.time()
+        tails, heads, capacities, costs, s, d = self._solver_arcs(src, dest, amt)
+        # the channel of every arc as its position in the arc slots
+        channel = self._position[self._arc_rows]
+        number_of_channels = len(self._rows)
+        base_fees = self._channel_table.base_fee[self._rows]
+        charged_base_fees = np.where(base_fees > self._base_fee, base_fees, 0)
+        estimates = approximation.initial_estimates(
+            np.bincount(channel, weights=capacities, minlength=number_of_channels).astype(np.int64), amt)
+
+        best_flows, best_cost = None, None
+        for _ in range(approximation.max_iterations):
+            begin = time.time()
+            surcharges = approximation.unit_surcharges(charged_base_fees, estimates)
+            solver = MinCostFlowSolver()
+            solver.add_arcs(tails, heads, capacities, costs + self._mu * surcharges[channel])
+            solver.set_supplies([s, d], [int(amt), -int(amt)])
+            if solver.solve() != solver.OPTIMAL:
+                break
+            flows = solver.flows()
+            channel_flows = np.bincount(channel, weights=flows, minlength=number_of_channels).astype(np.int64)
+            # a base fee of b msat costs as much as 1000 * b ppm on one sat
+            cost = int((costs * flows).sum()) + self._mu * 1000 * int(charged_base_fees[channel_flows > 0].sum())
+            if best_cost is None or cost < best_cost:
+                best_flows, best_cost = flows, cost
+
+            next_estimates = approximation.next_estimates(channel_flows, estimates)
+            if np.array_equal(next_estimates, estimates):
+                break
+            estimates = next_estimates
+            now = time.time()
+            # stop if another solve of the same duration would exceed the budget
+            if now - start + (now - begin) > approximation.time_budget:
+                break
+        return best_flows
+
+    def solve_quantized(self, src, dest, amt: int, quantization: int):
+        """
+        computes the min cost flow to send `amt` from `src` to `dest` on capacities that are measured in
+        units of `quantization` satoshis
+
+        The quantized problem is solved for `amt // quantization` units. The resulting flow is scaled back
+        and the remaining `amt % quantization` sats are routed by a refinement pass on the residual graph
+        in which every arc is limited to the remainder. The refinement is a tiny problem, but it is exact:
+        the returned flow delivers exactly `amt`. The unit costs stay the same as the quantization of the
+        amount and of the capacities cancel out.
+
+        Returns the flow on all arcs given by `arc_rows` or None if the problem is infeasible. If the
+        rounded down capacities cannot carry the quantized amount the problem is solved unquantized.
+        """
+        tails, heads, capacities, costs, s, d = self._solver_arcs(src, dest, amt)
+        amount, remainder = divmod(int(amt), quantization)
+
+        quantized = MinCostFlowSolver()
+        quantized.add_arcs(tails, heads, capacities // quantization, costs)
+        quantized.set_supplies([s, d], [amount, -amount])
+        if quantized.solve() != quantized.OPTIMAL:
+            solver = MinCostFlowSolver()
+            solver.add_arcs(tails, heads, capacities, costs)
+            solver.set_supplies([s, d], [int(amt), -int(amt)])
+            if solver.solve() != solver.OPTIMAL:
+                return None
+            return solver.flows()
+        flows = quantized.flows() * quantization
+        if remainder == 0:
+            return flows
+
+        # residual arcs: forward arcs with the remaining capacity and backward arcs that cancel flow
+        refinement = MinCostFlowSolver()
+        refinement.add_arcs(np.concatenate([tails, heads]), np.concatenate([heads, tails]),
+                            np.concatenate([np.minimum(capacities - flows, remainder),
+                                            np.minimum(flows, remainder)]),
+                            np.concatenate([costs, -costs]))
+        refinement.set_supplies([s, d], [remainder, -remainder])
+        if refinement.solve() != refinement.OPTIMAL:
+            return None
+        refined = refinement.flows()
+        return flows + refined[:len(tails)] - refined[len(tails):]
+
+    def channel_flows(self, flows):
+        """
+        sums the flow of the arcs given by `arc_rows` up per row of the channel table
+        """
+        channel_flows = np.zeros(len(self._channel_table), dtype=np.int64)
+        np.add.at(channel_flows, self._arc_rows, flows)
+        return channel_flows
+
+    def flow_statistics(self, channel_flows):
+        """
+        returns the routing fee in sat (not including downstream fees) and the success probability of a
+        flow given per row of the channel table
+        """
+        rows = np.flatnonzero(channel_flows)
+        table = self._channel_table
+        fee_msat = (table.ppm[rows] * channel_flows[rows] / 1000).astype(np.int64) + table.base_fee[rows]
+        probability = float(np.prod(table.success_probability(channel_flows[rows], rows)))
+        return int(fee_msat.sum()) / 1000., probability
+
+    @property
+    def arc_rows(self):
+        """
+        the rows of the channel table that the arcs of the last solver (or `solve_incremental`) belong to
+        """
+        return self._arc_rows
+
+    @arc_rows.setter
+    def arc_rows(self, arc_rows):
+        self._arc_rows = arc_rows
+
+    def arc_to_channel(self, index: int):
+        """
+        returns the `UncertaintyChannel` that the arc with `index` of the last solver belongs to
+        """
+        return self._uncertainty_network.channels[self._arc_rows[index]]
+
+    def _incremental_solver(self):
+        arc_rows = np.repeat(self._rows, self._slots_per_channel())
+        return IncrementalMinCostFlow(self._channel_table.src[arc_rows], self._channel_table.dest[arc_rows],
+                                      self._channel_table.number_of_nodes)
+
+    def warm_state(self):
+        """
+        returns a copy of the flow and the potentials of the last `solve_incremental` (None if there are none)
+        from which `restore_warm_state` can continue as long as the layout of the arc slots stays the same
+        """
+        if self._incremental is None or self._incremental.flow is None:
+            return None
+        return self._layout, self._terminals, self._incremental.flow.copy(), self._incremental.potential.copy()
+
+    def restore_warm_state(self, state):
+        """
+        lets the next `solve_incremental` for the same `src` and `dest` start from a `warm_state`
+
+        returns False (and changes nothing) if the layout of the arc slots changed since the state was taken
+        """
+        layout, terminals, flow, potential = state
+        if layout != self._layout:
+            return False
+        if self._incremental is None:
+            self._incremental = self._incremental_solver()
+        self._incremental.restore(flow, potential)
+        self._terminals = terminals
+        return True
+
+    def forget_warm_state(self):
+        """
+        drops the flow of the last `solve_incremental`, so that the next one starts from scratch
+        """
+        if self._incremental is not None:
+            self._incremental.reset()
+
+    def solve_incremental(self, src, dest, amt: int):
+        """
+        computes the min cost flow to send `amt` from `src` to `dest` warm started from the flow of the
+        previous call
+
+        The warm start is only used if the previous call was for the same `src` and `dest` and the arcs were
+        not rebuilt in between. Returns the flow on all slots of the model (see `arc_rows`) or None if the
+        problem is infeasible.
+        """
+        slots = self._slots_per_channel()
+        in_use = np.arange(slots)[None, :] < self._pruned_pieces(src, dest, amt)[:, None]
+        capacities = np.where(in_use, self._arc_capacities, 0).ravel()
+        arc_rows = np.repeat(self._rows, slots)
+        if self._incremental is None:
+            self._incremental = self._incremental_solver()
+        elif self._terminals != (src, dest):
+            self._incremental.reset()
+        self._terminals = (src, dest)
+        self._arc_rows = arc_rows
+
+        node_index = self._channel_table.node_index
+        if not self._incremental.solve(capacities, self._arc_costs.ravel(), node_index[src], node_index[dest],
+                                       int(amt)):
+            return None
+        return self._incremental.flow.copy()
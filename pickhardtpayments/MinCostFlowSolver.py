@@ -0,0 +1,82 @@
+import numpy as np
+
+try:
+    # the vectorized pybind11 API of the OR-lib (ortools >= 9.4)
+    from ortools.graph.python import min_cost_flow
+except ImportError:
+    min_cost_flow = None
+    from ortools.graph import pywrapgraph
+
+
+class MinCostFlowSolver:
+    """
+    A thin wrapper around the `SimpleMinCostFlow` solver of the Google OR-lib that moves whole numpy arrays
+    across the python / C++ boundary.
+
+    With ortools >= 9.4 the arcs, supplies and flows are passed to the solver through its vectorized API in
+    a single call each. Older versions only offer the per arc SWIG API of `pywrapgraph`, in which case the
+    wrapper falls back to looping over the arrays.
+    """
+
+    def __init__(self):
+        if min_cost_flow is not None:
+            self._solver = min_cost_flow.SimpleMinCostFlow()
+        else:
+            self._solver = pywrapgraph.SimpleMinCostFlow()
+        self._num_arcs = 0
+
+    @property
+    def OPTIMAL(self):
+        return self._solver.OPTIMAL
+
+    @property
+    def num_arcs(self):
+        return self._num_arcs
+
+    def add_arcs(self, tails, heads, capacities, costs):
+        """
+        adds all arcs given by the int64 arrays in one call and returns the arc indices
+        """
+        if min_cost_flow is not None:
+            arcs = self._solver.add_arcs_with_capacity_and_unit_cost(
+                np.ascontiguousarray(tails, dtype=np.int64), np.ascontiguousarray(heads, dtype=np.int64),
+                np.ascontiguousarray(capacities, dtype=np.int64), np.ascontiguousarray(costs, dtype=np.int64))
+        else:
+            arcs = np.array([self._solver.AddArcWithCapacityAndUnitCost(tail, head, capacity, cost)
+                             for tail, head, capacity, cost in zip(np.asarray(tails).tolist(),
+                                                                   np.asarray(heads).tolist(),
+                                                                   np.asarray(capacities).tolist(),
+                                                                   np.asarray(costs).tolist())],
+                            dtype=np.int64)
+        self._num_arcs += len(arcs)
+        return arcs
+
+    def set_supplies(self, nodes, supplies):
+        """
+        sets the supply of the given nodes. Nodes which are never mentioned have a supply of zero.
+        """
+        if min_cost_flow is not None:
+            self._solver.set_nodes_supplies(np.asarray(nodes, dtype=np.int64), np.asarray(supplies, dtype=np.int64))
+        else:
+            for node, supply in zip(np.asarray(nodes).tolist(), np.asarray(supplies).tolist()):
+                self._solver.SetNodeSupply(node, supply)
+
+    def solve(self):
+        if min_cost_flow is not None:
+            return self._solver.solve()
+        return self._solver.Solve()
+
+    def optimal_cost(self):
+        if min_cost_flow is not None:
+            return self._solver.optimal_cost()
+        return self._solver.OptimalCost()
+
+    def flows(self):
+        """
+        returns the flow on all arcs of the solved problem as one int64 array
+        """
+        if self._num_arcs == 0:
+            return np.zeros(0, dtype=np.int64)
+        if min_cost_flow is not None:
+            return np.asarray(self._solver.flows(np.arange(self._num_arcs, dtype=np.int64)), dtype=np.int64)
+        return np.array([self._solver.Flow(i) for i in range(self._num_arcs)], dtype=np.int64)
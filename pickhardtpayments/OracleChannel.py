@@ -1,6 +1,7 @@
 from .Channel import Channel
 
 import random
+import numpy as np
 
 
 class OracleChannel(Channel):
@@ -10,11 +11,24 @@ class OracleChannel(Channel):
     It contains a ground truth about the Liquidity of a channel
     """
 
-    def __init__(self, channel: Channel, actual_liquidity: int = None):
+    def __init__(self, channel: Channel, actual_liquidity: int = None, liquidity=None, row: int = None):
+        """
+        The actual liquidity is stored in the `row` of the `liquidity` array which is usually owned by the
+        `OracleLightningNetwork`. If no array is given the channel gets an array of its own.
+        """
         super().__init__(channel.cln_jsn)
-        self._actual_liquidity = actual_liquidity
+        if liquidity is None:
+            liquidity = np.zeros(1, dtype=np.int64)
+            row = 0
+        self._liquidity = liquidity
+        self._row = row
         if actual_liquidity is None or actual_liquidity >= self.capacity or actual_liquidity < 0:
-            self._actual_liquidity = random.randint(0, self.capacity)
+            actual_liquidity = random.randint(0, self.capacity)
+        self._liquidity[row] = actual_liquidity
+
+    @property
+    def row(self):
+        return self._row
 
     def __str__(self):
         return super().__str__() + " actual Liquidity: {}".format(self.actual_liquidity)
@@ -27,7 +41,7 @@ class OracleChannel(Channel):
         This is useful for experiments but must of course not be used in routing and is also
         not available if mainnet remote channels are being used.
         """
-        return self._actual_liquidity
+        return int(self._liquidity[self._row])
 
     @actual_liquidity.setter
     def actual_liquidity(self, amt: int):
@@ -37,7 +51,7 @@ class OracleChannel(Channel):
         :type amt: int
         """
         if 0 <= amt <= self.capacity:
-            self._actual_liquidity = amt
+            self._liquidity[self._row] = amt
         else:
             raise ValueError(f"Liquidity for channel {self.short_channel_id} cannot be set. Amount {amt} is negative or higher than capacity")
 
@@ -1,49 +1,176 @@
 from typing import List
 
+import networkx as nx
+
+from .Channel import Channel
 from .ChannelGraph import ChannelGraph
 from .OracleChannel import OracleChannel
-import networkx as nx
+from .MaxFlowSolver import MaxFlowSolver
+from .ChannelTable import path_rows
+from . import ChannelMath
+import numpy as np
 
 DEFAULT_BASE_THRESHOLD = 0
 
 
+class AggregatedCapacityGraph:
+    """
+    The actual liquidity of all channels up to a base fee threshold summed up per pair of nodes and loaded
+    into a `MaxFlowSolver`.
+
+    The graph keeps a copy of the `liquidity` (by row of the topology) that its arcs were computed from.
+    Before the next max flow the liquidity is compared with that copy and only the arcs of node pairs with
+    a changed channel are updated, no matter which code wrote the liquidity.
+    """
+
+    def __init__(self, channels: List[OracleChannel], liquidity, base_fee: int = DEFAULT_BASE_THRESHOLD):
+        self._node_index = {}
+        self._liquidity = liquidity
+        self._arc_of_row = np.full(len(liquidity), -1, dtype=np.int64)
+        arc_of_pair = {}
+        tails, heads = [], []
+        for channel in channels:
+            if channel.base_fee > base_fee:
+                continue
+            tail = self._node_index.setdefault(channel.src, len(self._node_index))
+            head = self._node_index.setdefault(channel.dest, len(self._node_index))
+            arc = arc_of_pair.setdefault((tail, head), len(arc_of_pair))
+            if arc == len(tails):
+                tails.append(tail)
+                heads.append(head)
+            self._arc_of_row[channel.row] = arc
+        self._rows = np.flatnonzero(self._arc_of_row >= 0)
+        self._number_of_arcs = len(tails)
+        self._synced_liquidity = liquidity.copy()
+        self._solver = MaxFlowSolver()
+        self._arcs = self._solver.add_arcs(tails, heads, self._capacities())
+
+    def _capacities(self):
+        capacities = np.zeros(self._number_of_arcs, dtype=np.int64)
+        np.add.at(capacities, self._arc_of_row[self._rows], self._liquidity[self._rows])
+        return capacities
+
+    def _sync(self):
+        """
+        updates the arcs of all node pairs whose channels changed their liquidity since the last sync
+        """
+        rows = np.flatnonzero(self._liquidity != self._synced_liquidity)
+        if len(rows) == 0:
+            return
+        arcs = np.unique(self._arc_of_row[rows])
+        arcs = arcs[arcs >= 0]
+        if len(arcs) > 0:
+            self._solver.set_capacities(self._arcs[arcs], self._capacities()[arcs])
+        self._synced_liquidity[rows] = self._liquidity[rows]
+
+    def maximum_flow(self, source: str, destination: str):
+        """
+        the value of a maximum flow from `source` to `destination`
+
+        raises a `NetworkXError` (as the min cut of networkx did) if one of them has no channel up to the
+        base fee threshold
+        """
+        for role, node in (("source", source), ("sink", destination)):
+            if node not in self._node_index:
+                raise nx.NetworkXError("{} node {} not in graph".format(role, node))
+        self._sync()
+        status = self._solver.solve(self._node_index[source], self._node_index[destination])
+        if status != self._solver.OPTIMAL:
+            raise ValueError("max flow from {} to {} could not be computed (status {})".format(
+                source, destination, status))
+        return self._solver.optimal_flow()
+
+
 class OracleLightningNetwork(ChannelGraph):
+    """
+    The ground truth about the liquidity of all channels which is used in experiments and simulations.
+
+    The network is an overlay on the `Topology` of the `ChannelGraph`: the actual liquidity of every
+    channel is kept in the `actual_liquidity` array by row of the topology and the `OracleChannels` are
+    views on it. The opposite direction of every channel is known from the twin rows of the topology.
+    """
 
     def __init__(self, channel_graph: ChannelGraph):
         self._channel_graph = channel_graph
-        self._network = nx.MultiDiGraph()
-        for src, dest, short_channel_id, channel in channel_graph.network.edges(data="channel", keys=True):
-            oracle_channel = None
-
+        self._topology = channel_graph.topology
+        self._network = None
+        # the aggregated capacity graphs for max flow computations by base fee threshold
+        self._capacity_graphs = {}
+        self._actual_liquidity = np.zeros(len(self._topology), dtype=np.int64)
+        self._channels = []
+        for row, (channel, twin) in enumerate(zip(self._topology.channels, self._topology.twin.tolist())):
             # If Channel in opposite direction already exists with liquidity information match the channel
-            if self._network.has_edge(dest, src):
-                if short_channel_id in self._network[dest][src]:
-                    capacity = channel.capacity
-                    opposite_channel = self._network[dest][src][short_channel_id]["channel"]
-                    opposite_liquidity = opposite_channel.actual_liquidity
-                    oracle_channel = OracleChannel(
-                        channel, capacity - opposite_liquidity)
-
-            if oracle_channel is None:
-                oracle_channel = OracleChannel(channel)
-
-            self._network.add_edge(oracle_channel.src,
-                                   oracle_channel.dest,
-                                   key=short_channel_id,
-                                   channel=oracle_channel)
+            if 0 <= twin < row:
+                oracle_channel = OracleChannel(channel, channel.capacity - int(self._actual_liquidity[twin]),
+                                               self._actual_liquidity, row)
+            else:
+                oracle_channel = OracleChannel(channel, liquidity=self._actual_liquidity, row=row)
+            self._channels.append(oracle_channel)
 
     @property
     def network(self):
+        """
+        a `nx.MultiDiGraph` of the `OracleChannels` which is only built when it is asked for
+        """
+        if self._network is None:
+            self._network = self._build_network(self._channels)
         return self._network
 
+    @property
+    def topology(self):
+        return self._topology
+
+    @property
+    def channels(self):
+        """
+        the `OracleChannels` indexed by their row in the `topology`
+        """
+        return self._channels
+
+    @property
+    def actual_liquidity(self):
+        """
+        the actual liquidity of all channels by row of the `topology`
+        """
+        return self._actual_liquidity
+
+    def get_channel_by_id(self, short_channel_id: str, direction: int):
+        row = self._topology.get_row(short_channel_id, direction)
+        if row is not None:
+            return self._channels[row]
+
+    def get_twin(self, channel: Channel):
+        """
+        returns the oracle channel in the opposite direction of `channel` (None if the network lacks it)
+        """
+        row = self._topology.get_row(channel.short_channel_id, channel.direction)
+        if row is not None and self._topology.twin[row] >= 0:
+            return self._channels[self._topology.twin[row]]
+
     def send_onion(self, path, amt):
         """
+        probes the channels of the path hop by hop and updates our knowledge about every probed channel
+
+        Paths of `UncertaintyChannels` of one `ChannelTable` are probed and learnt in one batch (see
+        `ChannelMath.probe_path`).
 
         :rtype: object
         """
+        channel_table, rows = path_rows(path)
+        if channel_table is not None:
+            oracle_rows = [self._topology.get_row(channel.short_channel_id, channel.direction) for channel in path]
+            if None not in oracle_rows:
+                failed = ChannelMath.probe_path(self._actual_liquidity, oracle_rows, channel_table.in_flight, rows,
+                                                amt)
+                probed = len(rows) if failed < 0 else failed + 1
+                success = np.ones(probed, dtype=bool)
+                success[probed - 1] = failed < 0
+                channel_table.update_knowledge(rows[:probed], amt, success)
+                if failed >= 0:
+                    return False, path[failed]
+                return True, None
         for channel in path:
-            oracle_channel = self.get_channel(
-                channel.src, channel.dest, channel.short_channel_id)
+            oracle_channel = self.get_channel_by_id(channel.short_channel_id, channel.direction)
             success_of_probe = oracle_channel.can_forward(
                 channel.in_flight + amt)
             # print(channel,amt,success_of_probe)
@@ -58,25 +185,16 @@ class OracleLightningNetwork(ChannelGraph):
 
         This is only useful for experiments and simulations if one wants to know what would be 
         possible to actually send before starting the payment loop
+
+        The liquidity of parallel channels is aggregated once per `base_fee` threshold into an
+        `AggregatedCapacityGraph` on which the OR-lib computes the max flow. Later calls only update the
+        channels whose liquidity changed since (e.g. by `settle_attempts`).
         """
-        test_network = nx.DiGraph()
-        for src, dest, channel in self.network.edges(data="channel"):
-            # liquidity = 0
-            # for channel in channels:
-            if channel.base_fee > base_fee:
-                continue
-            liquidity = self.get_channel(
-                src, dest, channel.short_channel_id).actual_liquidity
-            if liquidity > 0:
-                if test_network.has_edge(src, dest):
-                    test_network[src][dest]["capacity"] += liquidity
-                else:
-                    test_network.add_edge(src,
-                                          dest,
-                                          capacity=liquidity)
-
-        mincut, _ = nx.minimum_cut(test_network, source, destination)
-        return mincut
+        capacity_graph = self._capacity_graphs.get(base_fee)
+        if capacity_graph is None:
+            capacity_graph = AggregatedCapacityGraph(self._channels, self._actual_liquidity, base_fee)
+            self._capacity_graphs[base_fee] = capacity_graph
+        return capacity_graph.maximum_flow(source, destination)
 
     def settle_payment(self, path: List[OracleChannel], payment_amount: int):
         """
@@ -86,14 +204,56 @@ class OracleLightningNetwork(ChannelGraph):
         # TODO testing
         """
         for channel in path:
-            settlement_channel = self.get_channel(channel.src, channel.dest, channel.short_channel_id)
-            return_settlement_channel = self.get_channel(channel.dest, channel.src, channel.short_channel_id)
+            settlement_channel = self.get_channel_by_id(channel.short_channel_id, channel.direction)
+            return_settlement_channel = self.get_twin(channel)
             if settlement_channel.actual_liquidity > payment_amount:
                 # decrease channel balance in sending channel by amount
                 settlement_channel.actual_liquidity = settlement_channel.actual_liquidity - payment_amount
-                # increase channel balance in the other direction by amount
-                return_settlement_channel.actual_liquidity = return_settlement_channel.actual_liquidity + payment_amount
+                # increase channel balance in the other direction by amount (which is not part of a network
+                # that was restricted to channels below a base fee threshold if it charges a higher base fee)
+                if return_settlement_channel is not None:
+                    return_settlement_channel.actual_liquidity += payment_amount
             else:
                 raise Exception("""Channel liquidity on Channel {} is lower than payment amount.
                     \nPayment cannot settle.""".format(channel.short_channel_id))
         return 0
+
+    def settle_attempts(self, attempts):
+        """
+        settles all arrived `attempts` of a payment atomically
+
+        The amounts of the attempts are summed up per channel and all channels are checked before any
+        liquidity is changed: every channel has to be part of the network and hold more liquidity than it
+        forwards in total (as in `settle_payment`) and no channel may exceed its capacity. If a check fails an
+        exception is raised and the liquidity of the network stays untouched. Otherwise every touched channel is updated once.
+        """
+        topology = self._topology
+        debits = {}
+        for attempt in attempts:
+            for channel in attempt.path:
+                row = topology.get_row(channel.short_channel_id, channel.direction)
+                if row is None:
+                    raise Exception("Channel {} is not part of the network.\nPayment cannot settle."
+                                    .format(channel.short_channel_id))
+                debits[row] = debits.get(row, 0) + attempt.amount
+
+        twins = topology.twin
+        deltas = {}
+        for row, amount in debits.items():
+            if self._actual_liquidity[row] <= amount:
+                raise Exception("""Channel liquidity on Channel {} is lower than payment amount.
+                    \nPayment cannot settle.""".format(self._channels[row].short_channel_id))
+            deltas[row] = deltas.get(row, 0) - amount
+            twin = int(twins[row])
+            if twin >= 0:
+                deltas[twin] = deltas.get(twin, 0) + amount
+        for row, delta in deltas.items():
+            if self._actual_liquidity[row] + delta > topology.capacity[row]:
+                raise Exception("Channel liquidity on Channel {} would exceed its capacity.\nPayment cannot settle."
+                                .format(self._channels[row].short_channel_id))
+
+        for row, delta in deltas.items():
+            if delta != 0:
+                channel = self._channels[row]
+                channel.actual_liquidity = channel.actual_liquidity + delta
+        return 0
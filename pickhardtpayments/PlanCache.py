@@ -0,0 +1,151 @@
+import math
+from collections import OrderedDict
+
+import numpy as np
+
+DEFAULT_MAX_ENTRIES = 1024
+DEFAULT_BUCKETS_PER_OCTAVE = 4
+
+
+class CachedPlan:
+    """
+    The routes that were planned for a payment together with what is needed to tell whether they still fit
+
+    `paths` are the routes as rows of the `channel_table` and the amount of every route, `rows` the distinct
+    channels of all routes. The routes are expected to hold their amounts in flight already (as planned
+    `Attempts` do). The plan remembers the `version` of the table (see `ChannelTable.version`), our belief
+    about the `rows` in `min_liquidity` and `max_liquidity` and their `in_flight` amounts without the amounts
+    of the plan itself. `warm_state` is the flow of the solver the plan was decomposed from (see
+    `MinCostFlowModel.warm_state`) or None.
+    """
+
+    def __init__(self, paths, amount: int, channel_table, warm_state=None):
+        self._paths = [(np.asarray(path, dtype=np.int64), int(path_amount)) for path, path_amount in paths]
+        self._amount = int(amount)
+        self._warm_state = warm_state
+        if self._paths:
+            self._rows = np.unique(np.concatenate([path for path, _ in self._paths]))
+        else:
+            self._rows = np.zeros(0, dtype=np.int64)
+        self._version = channel_table.version
+        self._min_liquidity = channel_table.min_liquidity[self._rows]
+        self._max_liquidity = channel_table.max_liquidity[self._rows]
+        self._in_flight = channel_table.in_flight[self._rows] - self.row_amounts()
+
+    @property
+    def paths(self):
+        return self._paths
+
+    @property
+    def amount(self):
+        return self._amount
+
+    @property
+    def version(self):
+        return self._version
+
+    @property
+    def warm_state(self):
+        return self._warm_state
+
+    @property
+    def rows(self):
+        return self._rows
+
+    @property
+    def min_liquidity(self):
+        return self._min_liquidity
+
+    @property
+    def max_liquidity(self):
+        return self._max_liquidity
+
+    @property
+    def in_flight(self):
+        return self._in_flight
+
+    def row_amounts(self, paths=None):
+        """
+        the amount that the given routes (the routes of the plan if None) lock in every row of `rows`
+        """
+        if paths is None:
+            paths = self._paths
+        totals = np.zeros(len(self._rows), dtype=np.int64)
+        if paths:
+            rows = np.concatenate([path for path, _ in paths])
+            amounts = np.repeat(np.array([amount for _, amount in paths], dtype=np.int64),
+                                [len(path) for path, _ in paths])
+            np.add.at(totals, np.searchsorted(self._rows, rows), amounts)
+        return totals
+
+    def scaled_paths(self, amt: int):
+        """
+        the routes of the plan with their amounts scaled proportionally to deliver `amt` instead
+
+        The rounding remainder is put on the route that carries the most and routes left without an amount
+        are dropped.
+        """
+        amounts = [path_amount * amt // self._amount for _, path_amount in self._paths]
+        if amounts:
+            largest = max(range(len(amounts)), key=lambda i: self._paths[i][1])
+            amounts[largest] += amt - sum(amounts)
+        return [(path, amount) for (path, _), amount in zip(self._paths, amounts) if amount > 0]
+
+
+class PlanCache:
+    """
+    Remembers the routes planned for a sender, a recipient and a range of amounts.
+
+    Payments between the same nodes for similar amounts lead to the same min cost flow. The amounts are
+    grouped into `buckets_per_octave` buckets for every doubling of the amount, so a bucket spans about 19%
+    with the default. Together with `mu` and the base fee threshold (which change the costs of the arcs)
+    this is the key of a plan. At most `max_entries` plans are kept and the least recently used one is
+    evicted first.
+
+    The cache does not decide whether a plan is still valid. The payment session compares the belief versions
+    of the rows of the plan in the `ChannelTable` with the version of the plan (see
+    `ChannelTable.belief_changed_since`) and, if they changed, our belief about them with the belief the plan
+    was computed from. The in_flight amounts of the rows have to be the same as well. Only then the routes
+    are sent again. Otherwise only the solver state of the plan is used to warm start the next solve.
+    """
+
+    def __init__(self, max_entries: int = DEFAULT_MAX_ENTRIES, buckets_per_octave: int = DEFAULT_BUCKETS_PER_OCTAVE):
+        if max_entries < 1:
+            raise ValueError("the plan cache needs room for at least one plan")
+        if buckets_per_octave < 1:
+            raise ValueError("the plan cache needs at least one bucket per doubling of the amount")
+        self._max_entries = max_entries
+        self._buckets_per_octave = buckets_per_octave
+        self._plans = OrderedDict()
+
+    def __len__(self):
+        return len(self._plans)
+
+    def bucket(self, amt: int):
+        """
+        the amount bucket of `amt`
+        """
+        return math.floor(math.log2(max(int(amt), 1)) * self._buckets_per_octave)
+
+    def _key(self, src, dest, amt: int, mu: int, base_fee: int):
+        return src, dest, self.bucket(amt), mu, base_fee
+
+    def get(self, src, dest, amt: int, mu: int, base_fee: int):
+        """
+        returns the `CachedPlan` for the payment or None
+        """
+        key = self._key(src, dest, amt, mu, base_fee)
+        plan = self._plans.get(key)
+        if plan is not None:
+            self._plans.move_to_end(key)
+        return plan
+
+    def put(self, src, dest, amt: int, mu: int, base_fee: int, plan: CachedPlan):
+        key = self._key(src, dest, amt, mu, base_fee)
+        self._plans[key] = plan
+        self._plans.move_to_end(key)
+        while len(self._plans) > self._max_entries:
+            self._plans.popitem(last=False)
+
+    def clear(self):
+        self._plans.clear()
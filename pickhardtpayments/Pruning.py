@@ -0,0 +1,160 @@
+from heapq import heappush, heappop
+
+import numpy as np
+
+from .ChannelTable import ChannelTable
+
+DEFAULT_QUANTILE = 0.5
+DEFAULT_CORE_PATHS = 3
+DEFAULT_AMOUNT_FRACTION = 0.1
+MAX_CACHED_PAYMENTS = 64
+
+
+class QuantilePruning:
+    """
+    Decides which channels are handed to the min cost flow solver for a payment of a given amount.
+
+    Every channel gets a normalized combined cost for forwarding the test amount `amount_fraction * amt`
+    (the share of the payment that a single channel is expected to carry):
+
+        -log2(success probability) / median + mu * fee / median
+
+    where both terms are normalized by their median over all channels, so that neither the amount nor
+    the choice of `mu` shifts the threshold. Channels with a cost up to the `quantile` of all costs are
+    kept. Since this alone may disconnect `src` from `dest` (or leave too little liquidity) the cheapest
+    edge disjoint paths between them are always kept as a core: at least `core_paths` of them and as many
+    as needed until their bottlenecks sum up to `amt`. If the greedily chosen paths cannot carry `amt`
+    nothing is pruned, so the pruned problem stays feasible whenever the unpruned one is.
+
+    The result is cached per `src`, `dest`, `amt` and `mu`, so repeated payments over an unchanged belief
+    (see `ChannelTable.version`) do not search the core again.
+    """
+
+    def __init__(self, quantile: float = DEFAULT_QUANTILE, core_paths: int = DEFAULT_CORE_PATHS,
+                 amount_fraction: float = DEFAULT_AMOUNT_FRACTION):
+        if not 0 < quantile <= 1:
+            raise ValueError("the quantile of channels to keep has to be in (0, 1]")
+        self._quantile = quantile
+        self._core_paths = core_paths
+        self._amount_fraction = amount_fraction
+        self._cache = {}
+
+    def normalized_costs(self, channel_table: ChannelTable, rows, amt: int, mu: int):
+        """
+        the normalized combined cost of every row for forwarding the test amount of a payment of `amt`
+        """
+        test_amount = max(int(amt * self._amount_fraction), 1)
+        probabilities = channel_table.success_probability(test_amount, rows)
+        with np.errstate(divide="ignore"):
+            uncertainty = -np.log2(probabilities)
+        fees = channel_table.ppm[rows] * test_amount / 1_000_000.
+        costs = uncertainty / _positive_median(uncertainty)
+        if mu > 0:
+            costs = costs + mu * fees / _positive_median(fees)
+        return costs
+
+    def _core(self, tails, heads, costs, capacities, number_of_nodes: int, src: int, dest: int, amt: int):
+        """
+        greedily collects cheapest edge disjoint paths from `src` to `dest` with Dijkstra
+
+        returns the indices of the edges of the core and the sum of the bottlenecks of its paths
+        """
+        # the out edges of every node in compressed sparse row form as in `Topology`
+        edges = np.flatnonzero(capacities > 0)
+        edges = edges[np.argsort(tails[edges], kind="stable")]
+        offsets = np.zeros(number_of_nodes + 1, dtype=np.int64)
+        offsets[1:] = np.cumsum(np.bincount(tails[edges], minlength=number_of_nodes))
+        offsets = offsets.tolist()
+        edges = edges.tolist()
+        tails = tails.tolist()
+        heads = heads.tolist()
+        costs = costs.tolist()
+        capacities = capacities.tolist()
+
+        blocked = set()
+        core = []
+        delivered = 0
+        while len(core) < self._core_paths or delivered < amt:
+            distance = {src: 0.}
+            parent_edge = {}
+            done = set()
+            heap = [(0., src)]
+            while heap:
+                d, node = heappop(heap)
+                if node in done:
+                    continue
+                done.add(node)
+                if node == dest:
+                    break
+                for edge in edges[offsets[node]:offsets[node + 1]]:
+                    if edge in blocked:
+                        continue
+                    head = heads[edge]
+                    candidate = d + costs[edge]
+                    if head not in done and candidate < distance.get(head, float("inf")):
+                        distance[head] = candidate
+                        parent_edge[head] = edge
+                        heappush(heap, (candidate, head))
+            if dest not in done:
+                break
+
+            path = []
+            node = dest
+            while node != src:
+                edge = parent_edge[node]
+                path.append(edge)
+                node = tails[edge]
+            blocked.update(path)
+            core.append(path)
+            delivered += min(capacities[edge] for edge in path)
+        return [edge for path in core for edge in path], delivered
+
+    def keep(self, channel_table: ChannelTable, rows, capacities, src: int, dest: int, amt: int, mu: int):
+        """
+        returns a boolean mask over `rows` of the channels that should be handed to the solver
+
+        `capacities` holds the summed capacity of the pieces of every row and `src` and `dest` are node
+        indices of the channel table. The mask of a payment is reused as long as none of the `rows` changed
+        since it was computed (see `ChannelTable.row_versions`) and the capacities are the same.
+        """
+        key = (src, dest, amt, mu)
+        cached = self._cache.get(key)
+        if cached is not None:
+            version, cached_rows, cached_capacities, keep = cached
+            if (np.array_equal(cached_rows, rows) and np.array_equal(cached_capacities, capacities)
+                    and not channel_table.changed_since(rows, version)):
+                return keep
+        version = channel_table.version
+        keep = self._keep(channel_table, rows, capacities, src, dest, amt, mu)
+        self._cache.pop(key, None)
+        if len(self._cache) >= MAX_CACHED_PAYMENTS:
+            del self._cache[next(iter(self._cache))]
+        self._cache[key] = (version, rows.copy(), capacities.copy(), keep)
+        return keep
+
+    def _keep(self, channel_table: ChannelTable, rows, capacities, src: int, dest: int, amt: int, mu: int):
+        costs = self.normalized_costs(channel_table, rows, amt, mu)
+        finite = np.isfinite(costs)
+        keep = np.zeros(len(rows), dtype=bool)
+        penalty = 1.
+        if finite.any():
+            keep = finite & (costs <= np.quantile(costs[finite], self._quantile))
+            penalty = float(costs[finite].max()) * len(rows) + 1
+        # channels that cannot forward the test amount may still carry a smaller part within the core
+        core_costs = np.where(finite, costs, penalty)
+        core, delivered = self._core(channel_table.src[rows], channel_table.dest[rows], core_costs, capacities,
+                                     channel_table.number_of_nodes, src, dest, amt)
+        if delivered < amt:
+            return capacities > 0
+        keep[np.array(core, dtype=np.int64)] = True
+        return keep & (capacities > 0)
+
+
+def _positive_median(values):
+    """
+    median of the finite positive values which is used to normalize them (1 if there are none)
+    """
+    values = values[np.isfinite(values) & (values > 0)]
+    if len(values) == 0:
+        return 1.
+    return float(np.median(values))
@@ -0,0 +1,124 @@
+"""
+Simulation.py
+====================================
+Runs many independent payment experiments in parallel worker processes.
+
+Every worker opens the same `Snapshot` file (which has to contain the liquidity of an oracle). The
+columns of the snapshot are mapped copy on write, so all workers share one image of the channel graph
+in the page cache while the belief of every worker stays private to it. Between two experiments a
+worker forgets everything it learnt and restores the liquidity of its oracle, so the experiments are
+independent of each other and of the order in which they are run.
+"""
+
+import multiprocessing
+import os
+import time
+from typing import List
+
+from .Attempt import AttemptStatus
+from .Snapshot import Snapshot
+from .SyncSimulatedPaymentSession import SyncSimulatedPaymentSession, DEFAULT_BASE_THRESHOLD
+
+# the state of a worker process which is set up once by `_init_worker`
+_worker = None
+
+
+def experiment_grid(pairs, amounts, mus=(1,), bases=(DEFAULT_BASE_THRESHOLD,)):
+    """
+    returns one experiment for every combination of a `(src, dest)` pair, an amount, a mu and a base fee
+    threshold
+    """
+    return [{"src": src, "dest": dest, "amt": amt, "mu": mu, "base": base}
+            for src, dest in pairs for amt in amounts for mu in mus for base in bases]
+
+
+class _Worker:
+    """
+    the private `UncertaintyNetwork`, oracle and payment session of one worker process
+    """
+
+    def __init__(self, snapshot_file: str, session_class, session_kwargs: dict, quiet: bool):
+        snapshot = Snapshot(snapshot_file, mode="c")
+        channel_graph = snapshot.channel_graph()
+        self._uncertainty_network = snapshot.uncertainty_network(channel_graph)
+        self._oracle = snapshot.oracle_lightning_network(channel_graph)
+        self._liquidity = [(channel, channel.actual_liquidity) for channel in self._oracle.channels]
+        self._session = session_class(self._oracle, self._uncertainty_network, quiet=quiet, **session_kwargs)
+
+    def _reset(self):
+        # also drops the plan cache and the warm state of the session
+        self._session.forget_information()
+        for channel, liquidity in self._liquidity:
+            channel.actual_liquidity = liquidity
+
+    def run(self, experiment: dict):
+        self._reset()
+        entropy_start = self._uncertainty_network.entropy()
+        start = time.time()
+        payment = self._session.pickhardt_pay(experiment["src"], experiment["dest"], experiment["amt"],
+                                              experiment.get("mu", 1), experiment.get("base", DEFAULT_BASE_THRESHOLD))
+        runtime = time.time() - start
+
+        result = dict(experiment)
+        result["runtime"] = runtime
+        result["learnt_entropy"] = entropy_start - self._uncertainty_network.entropy()
+        result["successful"] = payment.successful
+        result["attempts"] = len(payment.attempts)
+        result["failed_attempts"] = len(list(payment.filter_attempts(AttemptStatus.FAILED)))
+        result["settlement_fees"] = payment.settlement_fees
+        result["ppm"] = int(payment.settlement_fees * 1000 / payment.total_amount) if payment.successful else None
+        return result
+
+
+def _init_worker(snapshot_file: str, session_class, session_kwargs: dict, quiet: bool):
+    global _worker
+    _worker = _Worker(snapshot_file, session_class, session_kwargs, quiet)
+
+
+def _run_experiment(indexed_experiment):
+    index, experiment = indexed_experiment
+    return index, _worker.run(experiment)
+
+
+class Simulation:
+    """
+    A pool of worker processes that run payment experiments against a snapshot of a network.
+
+    `session_class` (a `SyncSimulatedPaymentSession` by default) is created once per worker with the
+    `session_kwargs`. An experiment is a dictionary with the keys `src`, `dest` and `amt` and optionally
+    `mu` and `base` (see `experiment_grid`). With `quiet` (handed to the sessions) the payment loop prints nothing.
+    """
+
+    def __init__(self, snapshot_file: str, workers: int = None, session_class=SyncSimulatedPaymentSession,
+                 quiet: bool = True, **session_kwargs):
+        if not os.path.exists(snapshot_file):
+            raise ValueError("snapshot {} does not exist".format(snapshot_file))
+        self._snapshot_file = snapshot_file
+        self._workers = workers if workers is not None else os.cpu_count() or 1
+        self._session_class = session_class
+        self._session_kwargs = session_kwargs
+        self._quiet = quiet
+
+    def run(self, experiments: List[dict]) -> List[dict]:
+        """
+        runs all experiments and returns one result per experiment in the same order
+
+        A result is the experiment extended by `successful`, `attempts`, `failed_attempts`,
+        `settlement_fees` (in msat), `ppm`, `learnt_entropy` and `runtime`.
+        """
+        initargs = (self._snapshot_file, self._session_class, self._session_kwargs, self._quiet)
+        indexed_experiments = list(enumerate(experiments))
+        results = [None] * len(experiments)
+        if self._workers == 1:
+            _init_worker(*initargs)
+            for index, experiment in indexed_experiments:
+                results[index] = _worker.run(experiment)
+            return results
+
+        # workers inherit the imported modules via fork where available and open the snapshot themselves
+        methods = multiprocessing.get_all_start_methods()
+        context = multiprocessing.get_context("fork" if "fork" in methods else None)
+        with context.Pool(self._workers, initializer=_init_worker, initargs=initargs) as pool:
+            for index, result in pool.imap_unordered(_run_experiment, indexed_experiments):
+                results[index] = result
+        return results
@@ -0,0 +1,220 @@
+"""
+Snapshot.py
+====================================
+A versioned binary snapshot of the channel graph, the channel parameters and our belief about the
+liquidity of the channels of an `UncertaintyNetwork` (and optionally the ground truth of an
+`OracleLightningNetwork`).
+
+Layout of a snapshot file (all integers little endian)::
+
+    header     magic, version, flags and the number of rows, nodes and short channel ids (HEADER_SIZE bytes)
+    columns    one 8 byte array with one entry per row for every name in COLUMNS (int64 except for the
+               float64 unix timestamps in `learnt_at`)
+    strings    utf-8, newline separated: all node ids, all short channel ids and the features of every row
+
+The columns are opened with `numpy.memmap`, so loading a snapshot does not copy or parse the numeric data
+and several processes that open the same file share one image of it in the page cache.
+"""
+
+import struct
+
+import numpy as np
+
+from .Channel import Channel, ChannelFields
+from .ChannelGraph import ChannelGraph
+from .ChannelTable import ChannelTable
+from .UncertaintyNetwork import UncertaintyNetwork
+from .OracleLightningNetwork import OracleLightningNetwork
+
+MAGIC = b"PPSNAP\x00\x00"
+# version 2 added the timestamps and the belief at the time of learning
+VERSION = 2
+HEADER_FORMAT = "<8sIIQQQ"
+HEADER_SIZE = 64
+
+# the snapshot contains the ground truth of an OracleLightningNetwork
+FLAG_ORACLE = 1
+
+COLUMNS = ("src", "dest", "short_channel_id", "capacity", "ppm", "base_fee", "cltv_delta", "htlc_minimum_msat",
+           "htlc_maximum_msat", "channel_flags", "public", "active", "last_update", "min_liquidity",
+           "max_liquidity", "in_flight", "actual_liquidity", "learnt_at", "learnt_min_liquidity",
+           "learnt_max_liquidity")
+
+
+def _msat(value):
+    """
+    core lightning reports msat values either as integers or as strings like '1000msat'
+    """
+    if isinstance(value, str):
+        return int(value[:-len("msat")]) if value.endswith("msat") else int(value)
+    return int(value)
+
+
+def save_snapshot(filename: str, uncertainty_network: UncertaintyNetwork, oracle: OracleLightningNetwork = None):
+    """
+    writes the channels and our current belief about their liquidity of `uncertainty_network` to `filename`
+
+    If `oracle` is given the actual liquidity of every channel is stored as well. Rows that are `removed`
+    from the channel table (closed channels and channels above the base fee threshold of the network) are
+    not written.
+    """
+    table = uncertainty_network.channel_table
+    rows = np.flatnonzero(~table.removed)
+    channels = [uncertainty_network.channels[row] for row in rows.tolist()]
+    columns = {
+        "src": table.src[rows],
+        "dest": table.dest[rows],
+        "short_channel_id": table.short_channel_id[rows],
+        "capacity": table.capacity[rows],
+        "ppm": table.ppm[rows],
+        "base_fee": table.base_fee[rows],
+        "cltv_delta": [channel.cltv_delta for channel in channels],
+        "htlc_minimum_msat": [_msat(channel.htlc_min_msat) for channel in channels],
+        "htlc_maximum_msat": [_msat(channel.htlc_max_msat) for channel in channels],
+        "channel_flags": [channel.flags for channel in channels],
+        "public": [channel.is_announced for channel in channels],
+        "active": [channel.is_active for channel in channels],
+        "last_update": [channel.cln_jsn.get(ChannelFields.LAST_UPDATE, 0) for channel in channels],
+        "min_liquidity": table.min_liquidity[rows],
+        "max_liquidity": table.max_liquidity[rows],
+        "in_flight": table.in_flight[rows],
+        "actual_liquidity": np.zeros(len(rows), dtype=np.int64),
+        "learnt_at": table.learnt_at[rows],
+        "learnt_min_liquidity": table.learnt_min_liquidity[rows],
+        "learnt_max_liquidity": table.learnt_max_liquidity[rows],
+    }
+    flags = 0
+    if oracle is not None:
+        flags |= FLAG_ORACLE
+        columns["actual_liquidity"] = [oracle.get_channel(channel.src, channel.dest, channel.short_channel_id)
+                                       .actual_liquidity for channel in channels]
+
+    features = [str(channel.cln_jsn.get(ChannelFields.FEATURES, "")) for channel in channels]
+    strings = "\n".join(list(table.node_ids) + list(table.short_channel_ids) + features).encode("utf-8")
+
+    with open(filename, "wb") as f:
+        header = struct.pack(HEADER_FORMAT, MAGIC, VERSION, flags, len(rows), table.number_of_nodes,
+                             len(table.short_channel_ids))
+        f.write(header.ljust(HEADER_SIZE, b"\x00"))
+        for name in COLUMNS:
+            dtype = "<f8" if name == "learnt_at" else "<i8"
+            f.write(np.ascontiguousarray(columns[name], dtype=dtype).tobytes())
+        f.write(strings)
+
+
+class Snapshot:
+    """
+    A snapshot file opened via mmap.
+
+    `mode` is handed to `numpy.memmap`: with 'c' (the default) changes of our belief stay private to the
+    process (copy on write), with 'r+' they are written back to the file and with 'r' the snapshot is
+    read only which fails on any update of our belief.
+    """
+
+    def __init__(self, filename: str, mode: str = "c"):
+        with open(filename, "rb") as f:
+            header = f.read(HEADER_SIZE)
+            if len(header) < HEADER_SIZE:
+                raise ValueError("{} is not a snapshot".format(filename))
+            magic, version, flags, rows, nodes, short_channel_ids = struct.unpack_from(HEADER_FORMAT, header)
+            if magic != MAGIC:
+                raise ValueError("{} is not a snapshot".format(filename))
+            if version != VERSION:
+                raise ValueError("snapshot version {} is not supported (expected {})".format(version, VERSION))
+            f.seek(HEADER_SIZE + 8 * rows * len(COLUMNS))
+            strings = f.read().decode("utf-8").split("\n") if rows > 0 else []
+
+        self._flags = flags
+        self._number_of_rows = rows
+        self._node_ids = strings[:nodes]
+        self._short_channel_ids = strings[nodes:nodes + short_channel_ids]
+        self._features = strings[nodes + short_channel_ids:]
+        if rows > 0:
+            data = np.memmap(filename, dtype="<i8", mode=mode, offset=HEADER_SIZE, shape=(len(COLUMNS), rows))
+        else:
+            data = np.zeros((len(COLUMNS), 0), dtype=np.int64)
+        self._columns = {name: data[i] for i, name in enumerate(COLUMNS)}
+        self._channel_table = None
+
+    def __len__(self):
+        return self._number_of_rows
+
+    @property
+    def has_oracle(self):
+        return bool(self._flags & FLAG_ORACLE)
+
+    def column(self, name: str):
+        """
+        the memory mapped array of the column `name` (see COLUMNS)
+        """
+        return self._columns[name]
+
+    @property
+    def channel_table(self):
+        """
+        the `ChannelTable` of the snapshot whose columns are views on the mapping
+        """
+        if self._channel_table is None:
+            c = self._columns
+            self._channel_table = ChannelTable.from_arrays(self._node_ids, self._short_channel_ids, c["src"],
+                                                           c["dest"], c["short_channel_id"], c["capacity"],
+                                                           c["ppm"], c["base_fee"], c["min_liquidity"],
+                                                           c["max_liquidity"], c["in_flight"],
+                                                           c["learnt_at"].view("<f8"), c["learnt_min_liquidity"],
+                                                           c["learnt_max_liquidity"])
+        return self._channel_table
+
+    def channels(self):
+        """
+        recreates the `Channel` objects of all rows with the fields listed in `ChannelFields`
+        """
+        c = {name: column.tolist() for name, column in self._columns.items() if name not in (
+            "min_liquidity", "max_liquidity", "in_flight", "actual_liquidity", "learnt_at", "learnt_min_liquidity",
+            "learnt_max_liquidity")}
+        channels = []
+        for row in range(self._number_of_rows):
+            channels.append(Channel({
+                ChannelFields.SRC: self._node_ids[c["src"][row]],
+                ChannelFields.DEST: self._node_ids[c["dest"][row]],
+                ChannelFields.SHORT_CHANNEL_ID: self._short_channel_ids[c["short_channel_id"][row]],
+                ChannelFields.CAP: c["capacity"][row],
+                ChannelFields.FEE_RATE: c["ppm"][row],
+                ChannelFields.BASE_FEE_MSAT: c["base_fee"][row],
+                ChannelFields.CLTV: c["cltv_delta"][row],
+                ChannelFields.HTLC_MINIMUM_MSAT: "{}msat".format(c["htlc_minimum_msat"][row]),
+                ChannelFields.HTLC_MAXIMUM_MSAT: "{}msat".format(c["htlc_maximum_msat"][row]),
+                ChannelFields.FLAGS: c["channel_flags"][row],
+                ChannelFields.ANNOUNCED: bool(c["public"][row]),
+                ChannelFields.ACTIVE: bool(c["active"][row]),
+                ChannelFields.LAST_UPDATE: c["last_update"][row],
+                ChannelFields.FEATURES: self._features[row],
+            }))
+        return channels
+
+    def channel_graph(self):
+        return ChannelGraph.from_channels(self.channels())
+
+    def uncertainty_network(self, channel_graph: ChannelGraph = None):
+        """
+        creates an `UncertaintyNetwork` whose belief is stored in the memory mapped `channel_table`
+        """
+        if channel_graph is None:
+            channel_graph = self.channel_graph()
+        # the snapshot only contains channels that passed the base fee threshold when it was taken
+        base_threshold = int(self._columns["base_fee"].max()) if self._number_of_rows > 0 else 0
+        return UncertaintyNetwork(channel_graph, base_threshold, self.channel_table)
+
+    def oracle_lightning_network(self, channel_graph: ChannelGraph = None):
+        """
+        creates an `OracleLightningNetwork` with the actual liquidity that was stored in the snapshot
+        """
+        if not self.has_oracle:
+            raise ValueError("the snapshot does not contain the liquidity of an oracle")
+        if channel_graph is None:
+            channel_graph = self.channel_graph()
+        oracle = OracleLightningNetwork(channel_graph)
+        table = self.channel_table
+        for row, actual_liquidity in enumerate(self._columns["actual_liquidity"].tolist()):
+            oracle.get_channel(table.node_ids[table.src[row]], table.node_ids[table.dest[row]],
+                               table.short_channel_ids[table.short_channel_id[row]]).actual_liquidity = actual_liquidity
+        return oracle
@@ -0,0 +1,53 @@
+import numpy as np
+
+
+def hop_distances(tails, heads, source: int, number_of_nodes: int, max_hops: int = None):
+    """
+    breadth first search from `source` along the arcs given by `tails` and `heads` in vectorized levels
+
+    returns the number of hops from `source` to every node (-1 for nodes that are not reached within
+    `max_hops` hops)
+    """
+    distance = np.full(number_of_nodes, -1, dtype=np.int64)
+    distance[source] = 0
+    frontier = np.zeros(number_of_nodes, dtype=bool)
+    frontier[source] = True
+    hops = 0
+    while frontier.any() and (max_hops is None or hops < max_hops):
+        hops += 1
+        reached = heads[frontier[tails]]
+        reached = reached[distance[reached] < 0]
+        distance[reached] = hops
+        frontier = np.zeros(number_of_nodes, dtype=bool)
+        frontier[reached] = True
+    return distance
+
+
+def reachable_arcs(tails, heads, src: int, dest: int, number_of_nodes: int, max_hops: int = None):
+    """
+    returns a boolean mask of the arcs that lie on at least one route from `src` to `dest` with at most
+    `max_hops` hops
+
+    One search runs forward from `src` and one backwards from `dest`. An arc (u, v) can be part of such a
+    route iff hops(src, u) + 1 + hops(v, dest) <= max_hops.
+    """
+    tails = np.asarray(tails, dtype=np.int64)
+    heads = np.asarray(heads, dtype=np.int64)
+    from_src = hop_distances(tails, heads, src, number_of_nodes, max_hops)
+    to_dest = hop_distances(heads, tails, dest, number_of_nodes, max_hops)
+    mask = (from_src[tails] >= 0) & (to_dest[heads] >= 0)
+    if max_hops is not None:
+        mask &= from_src[tails] + 1 + to_dest[heads] <= max_hops
+    return mask
+
+
+def renumber_nodes(tails, heads, src: int, dest: int):
+    """
+    maps the nodes touched by the arcs (and `src` and `dest`) to the compact range 0, ..., k-1
+
+    returns the renumbered `tails` and `heads`, the renumbered `src` and `dest` and the array of the
+    original node of every new index
+    """
+    nodes = np.unique(np.concatenate([tails, heads, np.array([src, dest], dtype=np.int64)]))
+    return (np.searchsorted(nodes, tails), np.searchsorted(nodes, heads), int(np.searchsorted(nodes, src)),
+            int(np.searchsorted(nodes, dest)), nodes)
@@ -13,26 +13,49 @@ from .Attempt import Attempt, AttemptStatus
 from .Payment import Payment
 from .UncertaintyNetwork import UncertaintyNetwork
 from .OracleLightningNetwork import OracleLightningNetwork
-
-from ortools.graph import pywrapgraph
+from .MinCostFlowModel import MinCostFlowModel
+from .FlowDecomposition import FlowDecomposition, DecompositionPolicy
+from .AttemptSetEvaluator import AttemptSetEvaluator
+from .Pruning import QuantilePruning
+from .FixedCharge import FixedChargeApproximation
+from .PlanCache import PlanCache, CachedPlan
+from .Metrics import MetricsSink, SOLVER_BUILD_SECONDS, SOLVER_SOLVE_SECONDS, DECOMPOSITION_SECONDS, \
+    ONION_ROUND_TRIP_SECONDS, ATTEMPTS_PER_ROUND, LEARNT_ENTROPY_BITS, ROUNDS_TOTAL, ATTEMPTS_TOTAL, \
+    FAILED_ATTEMPTS_TOTAL, PAYMENTS_TOTAL, SUCCESSFUL_PAYMENTS_TOTAL, PLAN_CACHE_HITS_TOTAL, \
+    PLAN_CACHE_WARM_STARTS_TOTAL, INFEASIBLE_ROUNDS_TOTAL
 
 import time
-import networkx as nx
+import numpy as np
 
 DEFAULT_BASE_THRESHOLD = 0
 
+# the longest route that fits into an onion and the largest total CLTV that nodes accept by default
+MAX_ROUTE_HOPS = 20
+MAX_ROUTE_CLTV = 2016
+# the min_final_cltv_expiry of an invoice that does not specify it (BOLT 11)
+DEFAULT_FINAL_CLTV_DELTA = 18
+# how often the amount that could not be decomposed into routes within the bounds is solved again per round
+MAX_REPLANS = 3
+
+
+LOG_HANDLER_NAME = "pickhardt_pay"
+
 
 def set_logger():
-    # Set Logger
+    # Set Logger once per process, further calls must not add more handlers.
+    # The level is only raised to INFO, so a caller that configured DEBUG (or less) keeps it.
     logger = logging.getLogger()
-    logger.setLevel(logging.DEBUG)
+    if any(handler.get_name() == LOG_HANDLER_NAME for handler in logger.handlers):
+        return
+    if logger.getEffectiveLevel() > logging.INFO:
+        logger.setLevel(logging.INFO)
     formatter = logging.Formatter('%(asctime)s.%(msecs)03d | %(levelname)s | %(message)s', datefmt='%H:%M:%S')
     stdout_handler = logging.StreamHandler(sys.stdout)
-    stdout_handler.setLevel(logging.DEBUG)
     stdout_handler.setFormatter(formatter)
     file_handler = logging.FileHandler('pickhardt_pay.log')
-    file_handler.setLevel(logging.DEBUG)
     file_handler.setFormatter(formatter)
+    stdout_handler.set_name(LOG_HANDLER_NAME)
+    file_handler.set_name(LOG_HANDLER_NAME)
     logger.addHandler(file_handler)
     logger.addHandler(stdout_handler)
 
@@ -52,24 +75,102 @@ class SyncSimulatedPaymentSession:
     def __init__(self,
                  oracle: OracleLightningNetwork,
                  uncertainty_network: UncertaintyNetwork,
-                 prune_network: bool = True):
+                 prune_network: bool = True,
+                 decomposition_policy: DecompositionPolicy = DecompositionPolicy.SHORTEST,
+                 warm_start: bool = False,
+                 pruning: QuantilePruning = None,
+                 max_hops: int = None,
+                 quantization: int = 1,
+                 report_quantization: bool = False,
+                 max_linearization_error: float = None,
+                 metrics: MetricsSink = None,
+                 quiet: bool = False,
+                 speculative_mus: List[int] = None,
+                 speculative_workers: int = None,
+                 max_route_hops: int = MAX_ROUTE_HOPS,
+                 max_route_cltv: int = MAX_ROUTE_CLTV,
+                 fixed_charge: FixedChargeApproximation = None,
+                 plan_cache: PlanCache = None):
+        """
+        `max_hops` restricts every payment to the channels that lie on a route from the sender to the
+        recipient with at most this many hops (see `MinCostFlowModel`)
+
+        With a `quantization` larger than 1 the min cost flow is solved on capacities measured in units of
+        that many sats and refined to deliver the exact amount (see `MinCostFlowModel.solve_quantized`).
+        `report_quantization` additionally solves every round unquantized and logs how fee and success
+        probability of the quantized flow differ.
+
+        `max_linearization_error` switches to the adaptive linearization of the uncertainty cost whose
+        pieces approximate it up to this many bits and never reach beyond the amount of the payment.
+
+        Timings and counters of the payment loop are reported to `metrics` (see `Metrics.py`). With
+        `quiet` nothing is printed or logged and no statistics are formatted.
+
+        With `speculative_mus` every round is also solved for these values of `mu` on up to
+        `speculative_workers` threads and the plan with the best expected delivered amount net of fees is
+        sent (see `_compute_speculative_flows`). This cannot be combined with `warm_start` or a `quantization`.
+
+        No onion is planned along a route with more than `max_route_hops` hops or whose CLTV (including the
+        `DEFAULT_FINAL_CLTV_DELTA` of the recipient) exceeds `max_route_cltv`, as nodes would reject it. Either
+        bound can be switched off with None.
+
+        A `fixed_charge` approximation lets channels with a base fee above the `base` threshold of a payment
+        (up to its `max_base_fee`) into the solver and prices their base fee by iterated surcharges on their
+        unit cost (see `MinCostFlowModel.solve_fixed_charge`). The `uncertainty_network` has to contain these
+        channels, i.e. its `base_threshold` must be at least the `max_base_fee`. It cannot be combined with
+        `warm_start`, a `quantization` or `speculative_mus`.
+
+        With a `plan_cache` the routes of every round are remembered per sender, recipient and amount bucket.
+        As long as none of their channels changed in the `ChannelTable` since, a later round for the same key
+        sends them again (scaled to its amount) without solving. Otherwise the solve is warm started from the
+        flow of the cached plan (see `_generate_candidate_paths`). Rounds are then solved incrementally as
+        with `warm_start`, so the cache cannot be combined with a `quantization`, `speculative_mus` or a
+        `fixed_charge` approximation.
+        """
+        if speculative_mus and (warm_start or quantization > 1):
+            raise ValueError("speculative solving can not be combined with warm_start or quantization")
+        if fixed_charge is not None and (warm_start or quantization > 1 or speculative_mus):
+            raise ValueError("the fixed charge approximation can not be combined with warm_start, quantization or "
+                             "speculative solving")
+        if fixed_charge is not None and uncertainty_network.base_threshold < fixed_charge.max_base_fee:
+            raise ValueError("the fixed charge approximation needs an UncertaintyNetwork with a base_threshold of "
+                             "at least its max_base_fee ({} msat)".format(fixed_charge.max_base_fee))
+        if plan_cache is not None and (quantization > 1 or speculative_mus or fixed_charge is not None):
+            raise ValueError("the plan cache can not be combined with quantization, speculative solving or the "
+                             "fixed charge approximation")
         self._oracle = oracle
         self._uncertainty_network = uncertainty_network
         self._prune_network = prune_network
+        self._decomposition_policy = decomposition_policy
+        # repair the flow of the previous round instead of solving every round from scratch
+        self._warm_start = warm_start
+        self._quantization = quantization
+        self._report_quantization = report_quantization
+        self._metrics = metrics if metrics is not None else MetricsSink()
+        self._quiet = quiet
+        self._speculative_mus = list(speculative_mus) if speculative_mus else None
+        self._speculative_workers = speculative_workers
+        self._max_route_hops = max_route_hops
+        self._max_route_cltv = max_route_cltv
+        self._fixed_charge = fixed_charge
+        self._plan_cache = plan_cache
         self._prepare_integer_indices_for_nodes()
+        self._mcf_model = MinCostFlowModel(self._uncertainty_network, prune_network, pruning=pruning,
+                                           reachable_only=max_hops is not None, max_hops=max_hops,
+                                           max_linearization_error=max_linearization_error,
+                                           fixed_charge=fixed_charge)
 
     def _prepare_integer_indices_for_nodes(self):
         """
         necessary for the OR-lib by google and the min cost flow solver
 
         let's initialize the look-up tables for node_ids to integers from [0,...,#number of nodes]
-        this is necessary because of the API of the Google Operations Research min cost flow solver
+        this is necessary because of the API of the Google Operations Research min cost flow solver.
+        The indices are the node indices of the channel table of the UncertaintyNetwork
         """
-        self._mcf_id = {}
-        self._node_key = {}
-        for k, node_id in enumerate(self._uncertainty_network.network.nodes()):
-            self._mcf_id[node_id] = k
-            self._node_key[k] = node_id
+        channel_table = self._uncertainty_network.channel_table
+        self._mcf_id = channel_table.node_index
+        self._node_key = dict(enumerate(channel_table.node_ids))
 
     def _prepare_mcf_solver(self, src, dest, amt: int = 1, mu: int = 100_000_000,
                             base_fee: int = DEFAULT_BASE_THRESHOLD):
@@ -79,129 +180,50 @@ class SyncSimulatedPaymentSession:
         This function can define a value for mu to control how heavily we combine the uncertainty cost and fees Also
         the function supports only taking channels into account that don't charge a base_fee higher or equal to `base`
 
-        returns the instantiated min_cost_flow object from the Google OR-lib that contains the piecewise linearized
-        problem
+        returns the instantiated `MinCostFlowSolver` wrapping the Google OR-lib that contains the piecewise linearized
+        problem. The arcs are kept by the `MinCostFlowModel` of the session across rounds and only arcs of
+        channels that changed since the last round are linearized again.
         """
-        self._min_cost_flow = pywrapgraph.SimpleMinCostFlow()
-        self._arc_to_channel = {}
+        self._mcf_model.refresh(mu, base_fee, amt)
+        self._min_cost_flow = self._mcf_model.make_solver(src, dest, amt)
 
-        for s, d, channel in self._uncertainty_network.network.edges(data="channel"):
-            # ignore channels with too large base fee
-            if channel.base_fee > base_fee:
-                continue
-            # FIXME: Remove Magic Number for pruning
-            # Prune channels away that have too low success probability! This is a huge runtime boost
-            # However the pruning would be much better to work on quantiles of normalized cost
-            # So as soon as we have better Scaling, Centralization and feature engineering we can
-            # probably have a more focused pruning
-            if self._prune_network and channel.success_probability(250_000) < 0.9:
-                continue
-            cnt = 0
-            # QUANTIZATION):
-            for capacity, cost in channel.get_piecewise_linearized_costs(mu=mu):
-                index = self._min_cost_flow.AddArcWithCapacityAndUnitCost(self._mcf_id[s],
-                                                                          self._mcf_id[d],
-                                                                          capacity,
-                                                                          cost)
-                self._arc_to_channel[index] = (s, d, channel, 0)
-                if self._prune_network and cnt > 1:
-                    break
-                cnt += 1
-
-        # Add node supply to 0 for all nodes
-        for i in self._uncertainty_network.network.nodes():
-            self._min_cost_flow.SetNodeSupply(self._mcf_id[i], 0)
-
-        # add amount to sending node
-        self._min_cost_flow.SetNodeSupply(
-            self._mcf_id[src], int(amt))  # /QUANTIZATION))
-
-        # add -amount to recipient nods
-        self._min_cost_flow.SetNodeSupply(
-            self._mcf_id[dest], -int(amt))  # /QUANTIZATION))
-
-    def _next_hop(self, path):
-        """
-        generator to iterate through edges indexed by node id of paths
-
-        The path is a list of node ids. Each call returns a tuple src, dest of an edge in the path    
-        """
-        for i in range(1, len(path)):
-            src = path[i - 1]
-            dest = path[i]
-            yield src, dest
-
-    def _make_channel_path(self, G: nx.MultiDiGraph, path: List[str]):
-        """
-        network x returns a path as a list of node_ids. However, we need a list of `UncertaintyChannels`
-        Since the graph has parallel edges it is quite some work to get the actual channels that the
-        min cost flow solver produced
-        """
-        channel_path = []
-        bottleneck = 2 ** 63
-        for src, dest in self._next_hop(path):
-            w = 2 ** 63
-            c = None
-            flow = 0
-            for sid in G[src][dest].keys():
-                if G[src][dest][sid]["weight"] < w:
-                    w = G[src][dest][sid]["weight"]
-                    c = G[src][dest][sid]["channel"]
-                    flow = G[src][dest][sid]["flow"]
-            channel_path.append(c)
-
-            if flow < bottleneck:
-                bottleneck = flow
-
-        return channel_path, bottleneck
-
-    def _dissect_flow_to_paths(self, s, d):
+    def _decompose_flow(self, s, d, flows):
+        """
+        sums the flow of the arcs of the `MinCostFlowModel` up per channel and returns the paths (as rows of
+        the channel table) and their amounts that the `FlowDecomposition` peels off
+        """
+        channel_table = self._uncertainty_network.channel_table
+        # first collect all linearized arcs which are assigned a non-zero flow and sum them up per channel
+        channel_flows = self._mcf_model.channel_flows(flows)
+        rows = np.flatnonzero(channel_flows)
+
+        probabilities = None
+        if self._decomposition_policy == DecompositionPolicy.PROBABLE:
+            probabilities = channel_table.success_probability(channel_flows[rows], rows)
+        cltv_deltas = None
+        max_cltv = None
+        if self._max_route_cltv is not None:
+            channels = self._uncertainty_network.channels
+            cltv_deltas = [channels[row].cltv_delta for row in rows.tolist()]
+            max_cltv = self._max_route_cltv - DEFAULT_FINAL_CLTV_DELTA
+        decomposition = FlowDecomposition(channel_table.src[rows], channel_table.dest[rows],
+                                          channel_flows[rows], rows, probabilities, cltv_deltas)
+        return decomposition.paths(self._mcf_id[s], self._mcf_id[d], self._decomposition_policy,
+                                   self._max_route_hops, max_cltv)
+
+    def _dissect_flow_to_paths(self, s, d, flows):
         """
         A standard algorithm to dissect a flow into several paths.
 
-
-        FIXME: Note that this dissection while accurate is probably not optimal in practice. 
-        As noted in our Probabilistic payment delivery paper the payment process is a bernoulli trial 
-        and I assume it makes sense to dissect the flow into paths of similar likelihood to make most
-        progress but this is a mere conjecture at this point. I expect quite a bit of research will be
-        necessary to resolve this issue.
+        The flow of the piecewise linearized arcs is summed up per channel and the `FlowDecomposition`
+        peels off paths in the order given by the `DecompositionPolicy` of the session. `flows` holds the
+        flow of every arc of the `MinCostFlowModel` as given by its `arc_rows`.
         """
-        # first collect all linearized edges which are assigned a non-zero flow put them into a networkx graph
-        G = nx.MultiDiGraph()
-        for i in range(self._min_cost_flow.NumArcs()):
-            flow = self._min_cost_flow.Flow(i)  # *QUANTIZATION
-            if flow == 0:
-                continue
-
-            src, dest, channel, _ = self._arc_to_channel[i]
-            if G.has_edge(src, dest):
-                if channel.short_channel_id in G[src][dest]:
-                    G[src][dest][channel.short_channel_id]["flow"] += flow
-            else:
-                # FIXME: cost is not reflecting exactly the piecewise linearization
-                # Probably not such a big issue as we just dissect flow
-                G.add_edge(src, dest, key=channel.short_channel_id, flow=flow,
-                           channel=channel, weight=channel.combined_linearized_unit_cost())
-        used_flow = 1
-        attempts = []
-
-        # allocate flow to shortest / cheapest paths from src to dest as long as this is possible
-        # decrease flow along those edges. This is a standard mechanism to dissect a flow into paths
-        while used_flow > 0:
-            try:
-                path = nx.shortest_path(G, s, d)
-            except:
-                break
-            channel_path, used_flow = self._make_channel_path(G, path)
-            attempts.append(Attempt(channel_path, used_flow))
-
-            # reduce the flow from the selected path
-            for pos, hop in enumerate(self._next_hop(path)):
-                src, dest = hop
-                channel = channel_path[pos]
-                G[src][dest][channel.short_channel_id]["flow"] -= used_flow
-                if G[src][dest][channel.short_channel_id]["flow"] == 0:
-                    G.remove_edge(src, dest, key=channel.short_channel_id)
+        with self._metrics.timer(DECOMPOSITION_SECONDS):
+            attempts = []
+            channels = self._uncertainty_network.channels
+            for path, amount in self._decompose_flow(s, d, flows):
+                attempts.append(Attempt([channels[row] for row in path.tolist()], amount))
         return attempts
 
     def _generate_candidate_paths(self, src, dest, amt: int, mu: int = 100_000_000,
@@ -212,49 +234,211 @@ class SyncSimulatedPaymentSession:
 
         This is one step within the payment loop.
 
-        Returns the residual amount of the `amt` that could ne be delivered and the paid fees
-        (on a per channel base not including fees for downstream fees) for the delivered amount
+        Returns the `Attempts` of the round and the time it took to plan them. If the min cost flow problem is
+        infeasible no attempts are returned, so the caller ends the payment unsuccessfully.
 
-        the function also prints some results on statistics about the paths of the flow to stdout.
+        With a plan cache the routes of a cached plan whose channels are unchanged are used instead (see
+        `_attempts_from_plan`). A stale plan still provides the flow from which the solve is warm started. The
+        routes of the round are cached together with our belief about their channels and the in_flight amounts
+        of the channels without the amounts of the round, so allocating and releasing the amounts of the plan
+        does not make it stale but learning something about its channels does.
         """
         # initialisation of List of Attempts for this round.
         attempts_in_round = List[Attempt]
 
-        # First we prepare the min cost flow by getting arcs from the uncertainty network
-        self._prepare_mcf_solver(src, dest, amt, mu, base)
         start = time.time()
-        # print("solving mcf...")
-        status = self._min_cost_flow.Solve()
-
-        if status != self._min_cost_flow.OPTIMAL:
-            print('There was an issue with the min cost flow input.')
-            print(f'Status: {status}')
-            exit(1)
-
-        attempts_in_round = self._dissect_flow_to_paths(src, dest)
+        plan = None
+        if self._plan_cache is not None:
+            plan = self._plan_cache.get(src, dest, amt, mu, base)
+            if plan is not None:
+                attempts_in_round = self._attempts_from_plan(plan, amt)
+                if attempts_in_round is not None:
+                    self._metrics.increment(PLAN_CACHE_HITS_TOTAL)
+                    return attempts_in_round, time.time() - start
+        flows = self._compute_flows(src, dest, amt, mu, base, None if plan is None else plan.warm_state)
+        if flows is None:
+            return [], time.time() - start
+
+        attempts_in_round = self._dissect_flow_to_paths(src, dest, flows)
+        # the part of the flow that only runs along routes which are too long is solved again. The planned
+        # attempts hold their amounts in flight, so the solver is pushed to other channels
+        remainder = amt - sum(attempt.amount for attempt in attempts_in_round)
+        replans = 0
+        while remainder > 0 and replans < MAX_REPLANS:
+            flows = self._compute_flows(src, dest, remainder, mu, base)
+            if flows is None:
+                break
+            attempts = self._dissect_flow_to_paths(src, dest, flows)
+            if not attempts:
+                break
+            attempts_in_round += attempts
+            remainder -= sum(attempt.amount for attempt in attempts)
+            replans += 1
+        if self._plan_cache is not None and attempts_in_round:
+            self._cache_plan(src, dest, amt, mu, base, attempts_in_round, amt - remainder)
         end = time.time()
         return attempts_in_round, end - start
 
-    def _estimate_payment_statistics(self, attempts):
+    def _cache_plan(self, src, dest, amt: int, mu: int, base: int, attempts: List[Attempt], planned: int):
         """
-        estimates the success probability of paths and computes fees (without paying downstream fees)
+        stores the routes of the `attempts` of a round for `amt` together with our belief about their channels
+        and the in_flight amounts of the channels before the attempts allocated theirs
+        """
+        paths = [([channel.row for channel in attempt.path], attempt.amount) for attempt in attempts]
+        plan = CachedPlan(paths, planned, self._uncertainty_network.channel_table, self._mcf_model.warm_state())
+        self._plan_cache.put(src, dest, amt, mu, base, plan)
 
-        @returns the statistics in the `payments` dictionary
+    def _attempts_from_plan(self, plan: CachedPlan, amt: int):
         """
-        # compute fees and probabilities of candidate paths for evaluation
-        for attempt in attempts:
-            attempt.routing_fee, attempt.probability = self._uncertainty_network.get_features_of_candidate_path(
-                attempt.path, attempt.amount)
-            # logging.debug("fee: {attempt.routing_fee} msat, p = {attempt.probability:.4%}, amount: {attempt.amount}")
+        returns the `Attempts` of a cached plan scaled to deliver `amt` or None if the plan is stale
 
-            # to correctly compute conditional probabilities of non-disjoint paths in the same set of paths
-            self._uncertainty_network.allocate_amount_on_path(attempt.path, attempt.amount)
+        A plan is stale if our belief about one of its channels (including its decay) differs from the belief
+        it was computed from or if the in_flight amounts of its channels changed. Beliefs are only compared if
+        their versions changed since the plan was cached. With a larger amount than planned the routes must
+        also still fit into the liquidity that we believe the channels to have at most.
+        """
+        channel_table = self._uncertainty_network.channel_table
+        rows = plan.rows
+        channel_table.decay(rows)
+        if channel_table.belief_changed_since(rows, plan.version) and not (
+                np.array_equal(channel_table.min_liquidity[rows], plan.min_liquidity) and
+                np.array_equal(channel_table.max_liquidity[rows], plan.max_liquidity)):
+            return None
+        if not np.array_equal(channel_table.in_flight[rows], plan.in_flight):
+            return None
+        paths = plan.scaled_paths(amt)
+        if not paths:
+            return None
+        if amt > plan.amount:
+            if (channel_table.in_flight[rows] + plan.row_amounts(paths) > channel_table.max_liquidity[rows]).any():
+                return None
+        channels = self._uncertainty_network.channels
+        return [Attempt([channels[row] for row in path.tolist()], amount) for path, amount in paths]
+
+    def _compute_flows(self, src, dest, amt: int, mu: int, base: int, warm_state=None):
+        """
+        solves the min cost flow problem of one round with the solving mode of the session
 
-        # remove allocated amounts for all planned onions before doing actual attempts
-        for attempt in attempts:
-            self._uncertainty_network.allocate_amount_on_path(
-                attempt.path, -attempt.amount)
+        In the incremental modes the solve continues from `warm_state` (see `MinCostFlowModel.warm_state`)
+        if it is given and still fits the arcs of the model.
 
+        returns the flow on all arcs given by the `arc_rows` of the `MinCostFlowModel` or None if the
+        problem is infeasible (see `_report_infeasible`)
+        """
+        metrics = self._metrics
+        if self._warm_start or self._plan_cache is not None:
+            with metrics.timer(SOLVER_BUILD_SECONDS):
+                self._mcf_model.refresh(mu, base, amt)
+            if warm_state is not None and self._mcf_model.restore_warm_state(warm_state):
+                metrics.increment(PLAN_CACHE_WARM_STARTS_TOTAL)
+            with metrics.timer(SOLVER_SOLVE_SECONDS):
+                flows = self._mcf_model.solve_incremental(src, dest, amt)
+            if flows is None:
+                self._report_infeasible('The incremental min cost flow found no feasible flow')
+            return flows
+        if self._speculative_mus:
+            return self._compute_speculative_flows(src, dest, amt, mu, base)
+        if self._fixed_charge is not None:
+            with metrics.timer(SOLVER_BUILD_SECONDS):
+                self._mcf_model.refresh(mu, base, amt)
+            with metrics.timer(SOLVER_SOLVE_SECONDS):
+                flows = self._mcf_model.solve_fixed_charge(src, dest, amt)
+            if flows is None:
+                self._report_infeasible('The fixed charge approximation found no feasible flow')
+            return flows
+        if self._quantization > 1:
+            with metrics.timer(SOLVER_BUILD_SECONDS):
+                self._mcf_model.refresh(mu, base, amt)
+            with metrics.timer(SOLVER_SOLVE_SECONDS):
+                flows = self._mcf_model.solve_quantized(src, dest, amt, self._quantization)
+            if flows is None:
+                self._report_infeasible('The quantized min cost flow found no feasible flow')
+            elif self._report_quantization:
+                self._report_quantization_error(src, dest, amt, flows)
+            return flows
+        # First we prepare the min cost flow by getting arcs from the uncertainty network
+        with metrics.timer(SOLVER_BUILD_SECONDS):
+            self._prepare_mcf_solver(src, dest, amt, mu, base)
+        with metrics.timer(SOLVER_SOLVE_SECONDS):
+            status = self._min_cost_flow.solve()
+
+        if status != self._min_cost_flow.OPTIMAL:
+            self._report_infeasible('Status: {}'.format(status))
+            return None
+        return self._min_cost_flow.flows()
+
+    def _compute_speculative_flows(self, src, dest, amt: int, mu: int, base: int):
+        """
+        solves the round for `mu` and every value of `speculative_mus` in parallel and returns the flow of
+        the best plan or None if the problem is infeasible for all of them
+
+        The candidates share the arcs of the `MinCostFlowModel` and only differ in their costs (see
+        `MinCostFlowModel.solve_for_mus`). Every plan is decomposed into paths and scored by the
+        `AttemptSetEvaluator` with the sats it is expected to deliver minus its routing fee, so a cheaper
+        plan only wins if it does not lose more in expected delivered amount than it saves in fees. On a
+        tie the plan of `mu` itself is kept.
+        """
+        metrics = self._metrics
+        with metrics.timer(SOLVER_BUILD_SECONDS):
+            self._mcf_model.refresh(mu, base, amt)
+        # keep the order but solve every value only once
+        mus = list(dict.fromkeys([mu] + self._speculative_mus))
+        with metrics.timer(SOLVER_SOLVE_SECONDS):
+            candidates = self._mcf_model.solve_for_mus(src, dest, amt, mus, self._speculative_workers)
+
+        evaluator = AttemptSetEvaluator(self._uncertainty_network.channel_table)
+        best_mu, best_flows, best_statistics, best_score = None, None, None, None
+        for candidate_mu, flows in zip(mus, candidates):
+            if flows is None:
+                continue
+            paths = self._decompose_flow(src, dest, flows)
+            statistics = evaluator.evaluate_paths([path for path, _ in paths], [amount for _, amount in paths])
+            score = statistics.expected_amount - statistics.routing_fee / 1000
+            if best_score is None or score > best_score:
+                best_mu, best_flows, best_statistics, best_score = candidate_mu, flows, statistics, score
+
+        if best_flows is None:
+            self._report_infeasible('No candidate mu found a feasible flow')
+        elif not self._quiet:
+            logging.info("speculative solving picked mu %d of %s: %s", best_mu, mus, best_statistics)
+        return best_flows
+
+    def _report_quantization_error(self, src, dest, amt: int, flows):
+        """
+        solves the round unquantized and logs how much fee and success probability of the quantized flow
+        `flows` differ from the exact solution (nothing is solved in quiet mode)
+        """
+        if self._quiet:
+            return
+        quantized_fee, quantized_probability = self._mcf_model.flow_statistics(self._mcf_model.channel_flows(flows))
+        arc_rows = self._mcf_model.arc_rows
+        solver = self._mcf_model.make_solver(src, dest, amt)
+        if solver.solve() != solver.OPTIMAL:
+            return
+        fee, probability = self._mcf_model.flow_statistics(self._mcf_model.channel_flows(solver.flows()))
+        # make the arcs of the quantized solution current again
+        self._mcf_model.arc_rows = arc_rows
+        logging.info("quantization by %d sats changed the fee by %+.3f sat (exact %.3f sat) and the success "
+                     "probability by %+.2f%% (exact %.2f%%)", self._quantization, quantized_fee - fee, fee,
+                     (quantized_probability - probability) * 100, probability * 100)
+
+    def _report_infeasible(self, reason: str):
+        """
+        counts a round without a feasible flow and logs the `reason` unless the session is quiet
+        """
+        self._metrics.increment(INFEASIBLE_ROUNDS_TOTAL)
+        if not self._quiet:
+            logging.warning('There was an issue with the min cost flow input. %s', reason)
+
+    def _estimate_payment_statistics(self, attempts):
+        """
+        estimates the joint success probability of the paths over their shared channels, the expected
+        amount to be delivered (assuming the paths lock their amounts in order) and the fees (without paying
+        downstream fees) in one pass
+
+        @returns the `AttemptSetStatistics` of the attempts
+        """
+        return self._uncertainty_network.evaluate_attempts(attempts)
 
     def _attempt_payments(self, attempts: List[Attempt]):
         """
@@ -265,8 +449,9 @@ class SyncSimulatedPaymentSession:
         """
         # test actual payment attempts
         for attempt in attempts:
-            success, erring_channel = self._oracle.send_onion(
-                attempt.path, attempt.amount)
+            with self._metrics.timer(ONION_ROUND_TRIP_SECONDS):
+                success, erring_channel = self._oracle.send_onion(
+                    attempt.path, attempt.amount)
             if success:
                 # TODO: let this happen in Payment class? Or in Attempt class - with status change as settlement
                 attempt.status = AttemptStatus.ARRIVED
@@ -279,6 +464,29 @@ class SyncSimulatedPaymentSession:
                 # settled_onions.append(payments[key])
             else:
                 attempt.status = AttemptStatus.FAILED
+                self._metrics.increment(FAILED_ATTEMPTS_TOTAL)
+
+    def _record_round(self, attempts: List[Attempt]):
+        """
+        reports the attempts that were planned in one round to the metrics sink
+        """
+        self._metrics.increment(ROUNDS_TOTAL)
+        self._metrics.increment(ATTEMPTS_TOTAL, len(attempts))
+        self._metrics.observe(ATTEMPTS_PER_ROUND, len(attempts))
+
+    def _record_payment(self, payment: Payment):
+        """
+        reports the outcome of a finished payment to the metrics sink
+        """
+        self._metrics.increment(PAYMENTS_TOTAL)
+        if payment.successful:
+            self._metrics.increment(SUCCESSFUL_PAYMENTS_TOTAL)
+
+    def _settle_attempts(self, attempts: List[Attempt]):
+        """
+        settles the arrived attempts of a payment atomically on the OracleLightningNetwork
+        """
+        self._oracle.settle_attempts(attempts)
 
     def _evaluate_attempts(self, payment: Payment):
         """
@@ -286,6 +494,10 @@ class SyncSimulatedPaymentSession:
 
         returns the `residual` amount that could not have been delivered and some statistics
         """
+        if self._quiet:
+            residual_amt = sum(attempt.amount for attempt in payment.filter_attempts(AttemptStatus.FAILED))
+            paid_fees = sum(attempt.routing_fee for attempt in payment.filter_attempts(AttemptStatus.ARRIVED))
+            return residual_amt, paid_fees, len(payment.attempts), 0
         total_fees = 0
         paid_fees = 0
         residual_amt = 0
@@ -293,49 +505,43 @@ class SyncSimulatedPaymentSession:
         amt = 0
         arrived_attempts = []
         failed_attempts = []
-        print("\nStatistics about {} candidate onions:\n".format(len(payment.attempts)))
-        print("successful attempts:")
-        print("--------------------")
+        logging.info("statistics about %d candidate onions", len(payment.attempts))
         for arrived_attempt in payment.filter_attempts(AttemptStatus.ARRIVED):
             amt += arrived_attempt.amount
             total_fees += arrived_attempt.routing_fee / 1000.
             expected_sats_to_deliver += arrived_attempt.probability * arrived_attempt.amount
-            print(" p = {:6.2f}% amt: {:9} sats  hops: {} ppm: {:5}".format(
-                arrived_attempt.probability * 100, arrived_attempt.amount, len(arrived_attempt.path),
-                int(arrived_attempt.routing_fee * 1000 / arrived_attempt.amount)))
+            logging.info("successful attempt p = %6.2f%% amt: %9d sats  hops: %d ppm: %5d",
+                         arrived_attempt.probability * 100, arrived_attempt.amount, len(arrived_attempt.path),
+                         int(arrived_attempt.routing_fee * 1000 / arrived_attempt.amount))
             paid_fees += arrived_attempt.routing_fee
 
-        print("\nfailed attempts:")
-        print("----------------")
         for failed_attempt in payment.filter_attempts(AttemptStatus.FAILED):
             amt += failed_attempt.amount
             total_fees += failed_attempt.routing_fee / 1000.
             expected_sats_to_deliver += failed_attempt.probability * failed_attempt.amount
-            print(" p = {:6.2f}% amt: {:9} sats  hops: {} ppm: {:5}".format(
-                failed_attempt.probability * 100, failed_attempt.amount, len(failed_attempt.path),
-                int(failed_attempt.routing_fee * 1000 / failed_attempt.amount)))
+            logging.info("failed attempt p = %6.2f%% amt: %9d sats  hops: %d ppm: %5d",
+                         failed_attempt.probability * 100, failed_attempt.amount, len(failed_attempt.path),
+                         int(failed_attempt.routing_fee * 1000 / failed_attempt.amount))
             residual_amt += failed_attempt.amount
 
-        print("\nAttempt Summary:")
-        print("=================")
-        print("\nTried to deliver \t{:10} sats".format(amt))
-        fraction = expected_sats_to_deliver * 100. / amt
-        print("expected to deliver {:10} sats \t({:4.2f}%)".format(
-            int(expected_sats_to_deliver), fraction))
-        fraction = (amt - residual_amt) * 100. / (amt)
-        print("actually delivered {:10} sats \t({:4.2f}%)".format(
-            amt - residual_amt, fraction))
-        print("deviation: \t\t{:4.2f}".format(
-            (amt - residual_amt) / (expected_sats_to_deliver + 1)))
-        print("planned_fee: {:8.3f} sat".format(total_fees))
-        print("paid fees: {:8.3f} sat".format(paid_fees))
+        logging.info("tried to deliver %d sats, expected to deliver %d sats (%4.2f%%), actually delivered %d sats "
+                     "(%4.2f%%), deviation: %4.2f", amt, int(expected_sats_to_deliver),
+                     expected_sats_to_deliver * 100. / amt, amt - residual_amt, (amt - residual_amt) * 100. / amt,
+                     (amt - residual_amt) / (expected_sats_to_deliver + 1))
+        logging.info("planned fee: %8.3f sat, paid fees: %8.3f sat", total_fees, paid_fees)
         return residual_amt, paid_fees, len(payment.attempts), len(failed_attempts)
 
     def forget_information(self):
         """
         forgets all the information in the UncertaintyNetwork that is a member of the PaymentSession
+
+        The cached plans and the flow that the next solve would be warm started from were derived from
+        that information and are dropped as well, so the next payment is planned as by a new session.
         """
         self._uncertainty_network.reset_uncertainty_network()
+        if self._plan_cache is not None:
+            self._plan_cache.clear()
+        self._mcf_model.forget_warm_state()
 
     def activate_network_wide_uncertainty_reduction(self, n):
         """
@@ -351,8 +557,9 @@ class SyncSimulatedPaymentSession:
 
         """
 
-        set_logger()
-        logging.info('*** new pickhardt payment ***')
+        if not self._quiet:
+            set_logger()
+            logging.info('*** new pickhardt payment ***')
 
         # Setup
         entropy_start = self._uncertainty_network.entropy()
@@ -369,14 +576,23 @@ class SyncSimulatedPaymentSession:
         # a better stop criteria would be if we compute infeasible flows or if the probabilities
         # are too low or residual amounts decrease to slowly
         while amt > 0 and cnt < 10:
-            print("Round number: ", cnt + 1)
-            print("Try to deliver", amt, "satoshi:")
+            if not self._quiet:
+                logging.info("round number %d: try to deliver %d satoshi", cnt + 1, amt)
 
             sub_payment = Payment(payment.sender, payment.receiver, amt)
             # transfer to a min cost flow problem and run the solver
             # paths is the lists of channels, runtime the time it took to calculate all candidates in this round
             paths, runtime = self._generate_candidate_paths(payment.sender, payment.receiver, amt, mu, base)
+            if not paths:
+                if not self._quiet:
+                    logging.info("no route could be planned within the hop and CLTV bounds")
+                break
+            # the amount that could not be planned along routes within the bounds is left for the next round
+            unplanned = amt - sum(attempt.amount for attempt in paths)
             sub_payment.add_attempts(paths)
+            self._record_round(paths)
+            if not self._quiet and logging.getLogger().isEnabledFor(logging.DEBUG):
+                logging.debug("candidate paths of the round: %s", self._estimate_payment_statistics(paths))
 
             # make attempts, try to send onion and register if success or not
             # update our information about the UncertaintyNetwork
@@ -385,9 +601,10 @@ class SyncSimulatedPaymentSession:
             # run some simple statistics and depict them
             amt, paid_fees, num_paths, number_failed_paths = self._evaluate_attempts(
                 sub_payment)
+            amt += unplanned
 
-            print("Runtime of flow computation: {:4.2f} sec ".format(runtime))
-            print("\n================================================================\n")
+            if not self._quiet:
+                logging.info("runtime of flow computation: %4.2f sec", runtime)
 
             total_number_failed_paths += number_failed_paths
             total_fees += paid_fees
@@ -396,29 +613,136 @@ class SyncSimulatedPaymentSession:
             # add attempts of sub_payment to payment
             payment.add_attempts(sub_payment.attempts)
 
+        return self._finish_payment(payment, amt, cnt, entropy_start, mu)
+
+    def pickhardt_pay_batch(self, requests, mu=1, base=DEFAULT_BASE_THRESHOLD, max_rounds: int = 10):
+        """
+        conducts many payments given as a list of `(src, dest, amt)` tuples together and returns their
+        `Payment` objects in the same order
+
+        All payments are planned against the same UncertaintyNetwork and share one `MinCostFlowModel`.
+        In every round the open payments are planned one after another. The planned onions stay allocated
+        as in_flight, so every payment is planned around the liquidity that the previous payments of the
+        round reserved. Only channels which changed since the previous solve are linearized again,
+        so a round costs one solve per open payment and no rebuild of the arcs. Then all onions of the
+        round are sent and our belief is updated before the next round plans the residual amounts.
+        A payment whose residual amount cannot be planned anymore is given up.
+        """
+        if not self._quiet:
+            set_logger()
+            logging.info('*** new batch of %d pickhardt payments ***', len(requests))
+        entropy_start = self._uncertainty_network.entropy()
+        payments = [Payment(src, dest, amt) for src, dest, amt in requests]
+        residual = [payment.total_amount for payment in payments]
+        open_payments = [i for i, amt in enumerate(residual) if amt > 0]
+        rounds = 0
+        runtime = 0
+
+        while len(open_payments) > 0 and rounds < max_rounds:
+            rounds += 1
+            # build the arcs for the largest payment of the round so that no payment triggers a rebuild
+            self._mcf_model.refresh(mu, base, max(residual[i] for i in open_payments))
+            attempts = []
+            planned_payments = []
+            start = time.time()
+            for i in open_payments:
+                payment = payments[i]
+                flows = self._compute_flows(payment.sender, payment.receiver, residual[i], mu, base)
+                if flows is None:
+                    continue
+                planned = self._dissect_flow_to_paths(payment.sender, payment.receiver, flows)
+                payment.add_attempts(planned)
+                attempts.extend(planned)
+                planned_payments.append(i)
+            runtime += time.time() - start
+            self._record_round(attempts)
+
+            self._attempt_payments(attempts)
+            for i in planned_payments:
+                residual[i] = payments[i].total_amount - sum(
+                    attempt.amount for attempt in payments[i].filter_attempts(AttemptStatus.ARRIVED))
+            open_payments = [i for i in planned_payments if residual[i] > 0]
+            if not self._quiet:
+                logging.info("batch round %d: %d onions planned, %d payments still open", rounds, len(attempts),
+                             len(open_payments))
+
+        for payment, amt in zip(payments, residual):
+            self._settle_payment(payment, amt)
+            self._record_payment(payment)
+        self._metrics.observe(LEARNT_ENTROPY_BITS, entropy_start - self._uncertainty_network.entropy())
+        if not self._quiet:
+            self._log_batch_summary(payments, rounds, runtime, entropy_start)
+        return payments
+
+    def _settle_payment(self, payment: Payment, amt: int):
+        """
+        settles the arrived onions if the residual amount `amt` is zero
+
+        returns False if an onion could not be settled
+        """
         # When residual amount is 0 / enough successful onions have been found, then settle payment. Else drop onions.
         if amt == 0:
-            for onion in payment.filter_attempts(AttemptStatus.ARRIVED):
-                try:
-                    self._oracle.settle_payment(onion.path, onion.amount)
-                    onion.status = AttemptStatus.SETTLED
-                except Exception as e:
-                    print(e)
-                    return -1
+            arrived = list(payment.filter_attempts(AttemptStatus.ARRIVED))
+            try:
+                self._settle_attempts(arrived)
+            except Exception as e:
+                if not self._quiet:
+                    logging.warning(e)
+                return False
+            for onion in arrived:
+                onion.status = AttemptStatus.SETTLED
             payment.successful = True
         payment.end_time = time.time()
+        return True
 
+    def _finish_payment(self, payment: Payment, amt: int, cnt: int, entropy_start: float, mu: int):
+        """
+        settles the arrived onions if the residual amount `amt` is zero and concludes the payment
+
+        returns the `payment` which is not `successful` if the amount was not delivered or an onion could not
+        be settled
+        """
+        self._settle_payment(payment, amt)
+        return self._conclude_payment(payment, cnt, entropy_start, mu)
+
+    def _conclude_payment(self, payment: Payment, cnt: int, entropy_start: float, mu: int):
+        """
+        records the metrics of a settled (or given up) payment, logs its summary and returns it
+        """
+        self._record_payment(payment)
+        self._metrics.observe(LEARNT_ENTROPY_BITS, entropy_start - self._uncertainty_network.entropy())
+        if not self._quiet:
+            self._log_summary(payment, cnt, entropy_start, mu)
+        return payment
+
+    def _log_batch_summary(self, payments: List[Payment], rounds: int, runtime: float, entropy_start: float):
+        """
+        logs the statistics of a finished batch of payments
+        """
+        entropy_end = self._uncertainty_network.entropy()
+        attempts = [attempt for payment in payments for attempt in payment.attempts]
+        failed = [attempt for attempt in attempts if attempt.status == AttemptStatus.FAILED]
+        successful = [payment for payment in payments if payment.successful]
+        settlement_fees = sum(payment.settlement_fees for payment in successful)
+        delivered = sum(payment.total_amount for payment in successful)
+        logging.info("batch summary: %d rounds of mcf-computations, %d of %d payments successful, %d attempts "
+                     "made, %d failed", rounds, len(successful), len(payments), len(attempts), len(failed))
+        logging.info("runtime of flow computations: %4.2f sec, learnt entropy: %5.2f bits", runtime,
+                     entropy_start - entropy_end)
+        logging.info("fee for settlement of delivery: %8.3f sat --> %d ppm", settlement_fees / 1000,
+                     int(settlement_fees * 1000 / delivered) if delivered > 0 else 0)
+
+    def _log_summary(self, payment: Payment, cnt: int, entropy_start: float, mu: int):
+        """
+        logs the statistics of a finished payment
+        """
         entropy_end = self._uncertainty_network.entropy()
-        print("SUMMARY:")
-        print("========")
-        print("Rounds of mcf-computations:\t", cnt)
-        print("Number of attempts made:\t", len(payment.attempts))
-        print("Number of failed attempts:\t", len(list(payment.filter_attempts(AttemptStatus.FAILED))))
-        print("Failure rate: {:4.2f}% ".format(
-            len(list(payment.filter_attempts(AttemptStatus.FAILED))) * 100. / len(payment.attempts)))
-        print("total Payment lifetime (including inefficient memory management): {:4.3f} sec".format(
-            payment.end_time - payment.start_time))
-        print("Learnt entropy: {:5.2f} bits".format(entropy_start - entropy_end))
-        print("fee for settlement of delivery: {:8.3f} sat --> {} ppm".format(
-            payment.settlement_fees/1000, int(payment.settlement_fees * 1000 / payment.total_amount)))
-        print("used mu:", mu)
+        failed = len(list(payment.filter_attempts(AttemptStatus.FAILED)))
+        logging.info("summary: %d rounds of mcf-computations, %d attempts made, %d failed (failure rate %4.2f%%)",
+                     cnt, len(payment.attempts), failed,
+                     failed * 100. / len(payment.attempts) if payment.attempts else 0)
+        logging.info("total payment lifetime (including inefficient memory management): %4.3f sec",
+                     payment.end_time - payment.start_time)
+        logging.info("learnt entropy: %5.2f bits, used mu: %d", entropy_start - entropy_end, mu)
+        logging.info("fee for settlement of delivery: %8.3f sat --> %d ppm", payment.settlement_fees / 1000,
+                     int(payment.settlement_fees * 1000 / payment.total_amount))
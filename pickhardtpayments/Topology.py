@@ -0,0 +1,161 @@
+from typing import List
+
+import numpy as np
+
+from .Channel import Channel
+
+
+class Topology:
+    """
+    The immutable topology of a channel graph and the public parameters of its channels.
+
+    Every channel is identified by its row. Nodes and short_channel_ids are mapped to dense indices as in
+    the `ChannelTable`, whose static columns can be shared with the topology (`ChannelTable.from_topology`).
+    The outgoing and incoming channels of every node are kept in compressed sparse row (CSR) form and
+    `twin` holds the row of the opposite direction of every channel (-1 if the graph lacks it).
+
+    The `UncertaintyNetwork` and the `OracleLightningNetwork` are overlays on one topology: they only keep
+    arrays of their state (our belief, the actual liquidity) that refer to it by row, so the graph itself
+    is held in memory only once.
+    """
+
+    def __init__(self, channels: List[Channel]):
+        self._channels = list(channels)
+        self._node_ids = []
+        self._node_index = {}
+        self._short_channel_ids = []
+        self._short_channel_id_index = {}
+        self._row_index = {}
+
+        src, dest, short_channel_id = [], [], []
+        for row, channel in enumerate(self._channels):
+            src.append(self._add_node(channel.src))
+            dest.append(self._add_node(channel.dest))
+            scid = self._short_channel_id_index.get(channel.short_channel_id)
+            if scid is None:
+                scid = len(self._short_channel_ids)
+                self._short_channel_id_index[channel.short_channel_id] = scid
+                self._short_channel_ids.append(channel.short_channel_id)
+            short_channel_id.append(scid)
+            self._row_index[(channel.short_channel_id, channel.direction)] = row
+
+        self._src = np.array(src, dtype=np.int64)
+        self._dest = np.array(dest, dtype=np.int64)
+        self._short_channel_id = np.array(short_channel_id, dtype=np.int64)
+        self._capacity = np.array([channel.capacity for channel in self._channels], dtype=np.int64)
+        self._ppm = np.array([channel.ppm for channel in self._channels], dtype=np.int64)
+        self._base_fee = np.array([channel.base_fee for channel in self._channels], dtype=np.int64)
+        self._twin = np.array([self._row_index.get((channel.short_channel_id, 1 - channel.direction), -1)
+                               for channel in self._channels], dtype=np.int64)
+        self._out_offsets, self._out_rows = _csr(self._src, len(self._node_ids))
+        self._in_offsets, self._in_rows = _csr(self._dest, len(self._node_ids))
+
+    def _add_node(self, node_id: str):
+        index = self._node_index.get(node_id)
+        if index is None:
+            index = len(self._node_ids)
+            self._node_index[node_id] = index
+            self._node_ids.append(node_id)
+        return index
+
+    def __len__(self):
+        return len(self._channels)
+
+    def restrict(self, rows):
+        """
+        returns the topology of the channels in `rows` (e.g. all channels below a base fee threshold)
+        """
+        return Topology([self._channels[row] for row in np.asarray(rows).tolist()])
+
+    @property
+    def channels(self):
+        """
+        the `Channel` with the gossip data of every row
+        """
+        return self._channels
+
+    @property
+    def number_of_nodes(self):
+        return len(self._node_ids)
+
+    @property
+    def node_ids(self):
+        return self._node_ids
+
+    @property
+    def node_index(self):
+        return self._node_index
+
+    @property
+    def short_channel_ids(self):
+        return self._short_channel_ids
+
+    @property
+    def short_channel_id_index(self):
+        return self._short_channel_id_index
+
+    @property
+    def row_index(self):
+        return self._row_index
+
+    def get_row(self, short_channel_id: str, direction: int):
+        """
+        returns the row of the channel with `short_channel_id` in the given direction or None
+        """
+        return self._row_index.get((short_channel_id, direction))
+
+    def out_rows(self, node_id: str):
+        """
+        the rows of the channels that leave `node_id`
+        """
+        node = self._node_index.get(node_id)
+        if node is None:
+            return self._out_rows[:0]
+        return self._out_rows[self._out_offsets[node]:self._out_offsets[node + 1]]
+
+    def in_rows(self, node_id: str):
+        """
+        the rows of the channels that end in `node_id`
+        """
+        node = self._node_index.get(node_id)
+        if node is None:
+            return self._in_rows[:0]
+        return self._in_rows[self._in_offsets[node]:self._in_offsets[node + 1]]
+
+    @property
+    def src(self):
+        return self._src
+
+    @property
+    def dest(self):
+        return self._dest
+
+    @property
+    def short_channel_id(self):
+        return self._short_channel_id
+
+    @property
+    def capacity(self):
+        return self._capacity
+
+    @property
+    def ppm(self):
+        return self._ppm
+
+    @property
+    def base_fee(self):
+        return self._base_fee
+
+    @property
+    def twin(self):
+        return self._twin
+
+
+def _csr(nodes, number_of_nodes: int):
+    """
+    groups the rows by their node in `nodes` and returns the offsets of every node and the grouped rows
+    """
+    rows = np.argsort(nodes, kind="stable")
+    offsets = np.zeros(number_of_nodes + 1, dtype=np.int64)
+    offsets[1:] = np.cumsum(np.bincount(nodes, minlength=number_of_nodes))
+    return offsets, rows.astype(np.int64)
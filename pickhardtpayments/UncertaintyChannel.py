@@ -1,7 +1,10 @@
 from .Channel import Channel
+from .ChannelTable import ChannelTable
 from .OracleLightningNetwork import OracleLightningNetwork
 from math import log2 as log
 
+import numpy as np
+
 
 DEFAULT_MU = 1
 DEFAULT_N = 5
@@ -31,9 +34,19 @@ class UncertaintyChannel(Channel):
     TOTAL_NUMBER_OF_SATS = 21_000_000 * 100_000_000
     MAX_CHANNEL_SIZE = 15_000_000_000  # 150 BTC
 
-    def __init__(self, channel: Channel):
+    def __init__(self, channel: Channel, channel_table: ChannelTable = None, row: int = None):
+        """
+        The belief about the liquidity and the in_flight allocation are not stored in the object itself but
+        in the `row` of a `ChannelTable` which is usually owned by the `UncertaintyNetwork`. This allows
+        vectorized computations over all channels of the network. If no table is given the channel gets a
+        table of its own.
+        """
         super().__init__(channel.cln_jsn)
-        self.forget_information()
+        if channel_table is None:
+            channel_table = ChannelTable([channel])
+            row = 0
+        self._channel_table = channel_table
+        self._row = row
 
     def __str__(self):
         return "Size: {} with {:4.2f} bits of Entropy. Uncertainty Interval: [{},{}] inflight: {}".format(
@@ -43,32 +56,48 @@ class UncertaintyChannel(Channel):
             self.max_liquidity,
             self.in_flight)
 
+    @property
+    def channel_table(self):
+        return self._channel_table
+
+    @property
+    def row(self):
+        return self._row
+
     @property
     def max_liquidity(self):
-        return self._max_liquidity
+        self._channel_table.decay_row(self._row)
+        return int(self._channel_table.max_liquidity[self._row])
 
     @property
     def min_liquidity(self):
-        return self._min_liquidity
+        self._channel_table.decay_row(self._row)
+        return int(self._channel_table.min_liquidity[self._row])
+
+    @property
+    def learnt_at(self):
+        """
+        the unix timestamp at which we learnt our belief about the liquidity or 0 if we never did
+        """
+        return float(self._channel_table.learnt_at[self._row])
 
     @property
     def in_flight(self):
-        return self._in_flight
+        return int(self._channel_table.in_flight[self._row])
 
-    # FIXME: store timestamps when using setters so that we know when we learnt our belief
+    # the channel table stores the timestamp at which we learnt our belief
     @min_liquidity.setter
     def min_liquidity(self, value: int):
-        self._min_liquidity = value
+        self._channel_table.learn(self._row, min_liquidity=value)
 
-    # FIXME: store timestamps when using setters so that we know when we learnt our belief
     @max_liquidity.setter
     def max_liquidity(self, value: int):
-        self._max_liquidity = value
+        self._channel_table.learn(self._row, max_liquidity=value)
 
-    # FIXME: store timestamps when using setters so that we know when we learnt our belief
     @in_flight.setter
     def in_flight(self, value: int):
-        self._in_flight = value
+        self._channel_table.in_flight[self._row] = value
+        self._channel_table.mark_changed(self._row, belief=False)
 
     @property
     def conditional_capacity(self, respect_inflight=True):
@@ -86,17 +115,14 @@ class UncertaintyChannel(Channel):
         self.in_flight += amt
         if self.in_flight < 0:
             raise Exception(
-                "Can't remove in flight HTLC of amt {} current inflight: {}".format(-amt, self._in_flight-amt))
+                "Can't remove in flight HTLC of amt {} current inflight: {}".format(-amt, self.in_flight-amt))
 
-    # FIXME: store timestamps when using setters so that we know when we learnt our belief
     def forget_information(self):
         """
-        resets the information that we believe to have about the channel. 
+        resets the information that we believe to have about the channel (including when we learnt it).
         """
-        self.min_liquidity = 0
-        self.max_liquidity = self.capacity
         # FIXME: Is there a case where we want to keep inflight information but reset information?
-        self.in_flight = 0
+        self._channel_table.forget_information(np.array([self._row]))
 
     def entropy(self):
         """
@@ -284,8 +310,7 @@ class UncertaintyChannel(Channel):
             return
         amt = self.min_liquidity + \
             int((self.max_liquidity - self.min_liquidity)/2)
-        oracle_channel = oracle.get_channel(
-            self.src, self.dest, self.short_channel_id)
+        oracle_channel = oracle.get_channel_by_id(self.short_channel_id, self.direction)
         success_of_probing = oracle_channel.can_forward(amt)
         self.update_knowledge(amt, success_of_probing)
         self.learn_n_bits(oracle, n-1)
@@ -1,10 +1,14 @@
 from .ChannelGraph import ChannelGraph
 from .UncertaintyChannel import UncertaintyChannel
+from .ChannelTable import ChannelTable
+from .Topology import Topology
+from .Gossip import GossipEventType
 from .OracleLightningNetwork import OracleLightningNetwork
+from .AttemptSetEvaluator import AttemptSetEvaluator, AttemptSetStatistics
 
 
 from typing import List
-import networkx as nx
+import numpy as np
 
 DEFAULT_BASE_THRESHOLD = 0
 
@@ -21,25 +25,149 @@ class UncertaintyNetwork(ChannelGraph):
     Paths cannot be probed against the UncertaintyNetwork as it lacks an Oracle
     """
 
-    def __init__(self, channel_graph: ChannelGraph, base_threshold: int = DEFAULT_BASE_THRESHOLD):
-        self._channel_graph = nx.MultiDiGraph()
-        for src, dest, keys, channel in channel_graph.network.edges(data="channel", keys=True):
-            oracle_channel = UncertaintyChannel(channel)
-            if channel.base_fee <= base_threshold:
-                self._channel_graph.add_edge(oracle_channel.src,
-                                             oracle_channel.dest,
-                                             key=oracle_channel.short_channel_id,
-                                             channel=oracle_channel)
+    def __init__(self, channel_graph: ChannelGraph, base_threshold: int = DEFAULT_BASE_THRESHOLD,
+                 channel_table: ChannelTable = None):
+        """
+        Usually the `ChannelTable` that holds our belief is created from the channels of `channel_graph`.
+        An existing `channel_table` (e.g. one loaded from a `Snapshot`) can be given instead, in which case
+        every channel of the network has to have a row in it.
+        """
+        # the network is an overlay on the shared topology of `channel_graph`. Channels above the base fee
+        # threshold keep their rows but are flagged as `removed` in the channel table instead of copying the
+        # topology without them
+        topology = channel_graph.topology
+        self._topology = topology
+        self._channel_graph = None
+        self._base_threshold = base_threshold
+
+        channels = topology.channels
+        active = topology.base_fee <= base_threshold
+        if channel_table is None:
+            # the rows of the channel table are the rows of the topology
+            channel_table = ChannelTable.from_topology(topology, active)
+            rows = range(len(channels))
+        else:
+            if len(channel_table) != len(channels):
+                raise ValueError("The channel table has {} rows but the network {} channels".format(
+                    len(channel_table), len(channels)))
+            rows = [channel_table.get_row(channel.short_channel_id, channel.direction) for channel in channels]
+            if None in rows:
+                raise ValueError("The channel table does not contain all channels of the network")
+            channel_table.remove_rows(np.array(rows, dtype=np.int64)[~active])
+        self._channel_table = channel_table
+        self._channels = [None] * len(channels)
+        for row, channel in zip(rows, channels):
+            self._channels[row] = UncertaintyChannel(channel, self._channel_table, row)
 
     @property
     def network(self):
+        """
+        a `nx.MultiDiGraph` of the `UncertaintyChannels` which is only built when it is asked for
+        """
+        if self._channel_graph is None:
+            self._channel_graph = self._build_network(self._live_channels())
         return self._channel_graph
 
+    @property
+    def topology(self):
+        """
+        the `Topology` the network is an overlay on which includes the channels above the base fee threshold
+        (see `ChannelTable.removed`). After gossip was applied it is rebuilt from the current channels on
+        first use and its rows no longer match the rows of the `channel_table`.
+        """
+        if self._topology is None:
+            self._topology = Topology(self._live_channels())
+        return self._topology
+
+    def _live_channels(self):
+        removed = self._channel_table.removed
+        return [channel for row, channel in enumerate(self._channels) if not removed[row]]
+
+    def apply_gossip(self, events):
+        """
+        applies a stream of `GossipEvent`s to the network in place
+
+        Our belief about all channels that are not removed is kept. Updates take over the new fees and
+        capacity in the row of the channel, new channels get appended rows with a fresh belief and closed
+        channels are removed from the `channel_table` (see `ChannelTable.remove_rows`). All touched rows are
+        flagged as changed, so a `MinCostFlowModel` only linearizes their arcs again on its next `refresh`.
+        As on construction channels that charge a base fee above the threshold of the network are not part
+        of it, so an update that raises the base fee above it removes the channel.
+        """
+        table = self._channel_table
+        updates = {}
+        announcements = {}
+        removals = set()
+        for event in events:
+            row = table.get_row(*event.key)
+            if event.event_type == GossipEventType.REMOVE or event.channel.base_fee > self._base_threshold:
+                announcements.pop(event.key, None)
+                if row is not None:
+                    updates.pop(row, None)
+                    removals.add(row)
+            elif row is not None and row not in removals:
+                updates[row] = event.channel
+            else:
+                announcements[event.key] = event.channel
+        removals = sorted(removals)
+
+        rows = sorted(updates)
+        table.update_channels(rows, [updates[row] for row in rows])
+        for row in rows:
+            self._channels[row] = UncertaintyChannel(updates[row], table, row)
+        table.remove_rows(removals)
+        channels = list(announcements.values())
+        if channels:
+            for row, channel in zip(table.append_channels(channels).tolist(), channels):
+                self._channels.append(UncertaintyChannel(channel, table, row))
+        if rows or removals or channels:
+            self._channel_graph = None
+            self._topology = None
+
+    def get_channel_by_id(self, short_channel_id: str, direction: int):
+        row = self._channel_table.get_row(short_channel_id, direction)
+        if row is not None:
+            return self._channels[row]
+
+    @property
+    def channel_table(self):
+        """
+        the columnar store of our belief about all channels of the UncertaintyNetwork
+        """
+        return self._channel_table
+
+    @property
+    def base_threshold(self):
+        """
+        the largest base fee in msat of the channels that are not `removed` from the `channel_table`
+        """
+        return self._base_threshold
+
+    @property
+    def channels(self):
+        """
+        the `UncertaintyChannels` of the network indexed by their row in the `channel_table` (including the
+        `removed` rows)
+        """
+        return self._channels
+
+    @property
+    def belief_half_life(self):
+        """
+        the time in seconds after which our belief about the liquidity has lost half of its information
+        (None if our belief never decays)
+        """
+        return self._channel_table.half_life
+
+    @belief_half_life.setter
+    def belief_half_life(self, seconds: float):
+        self._channel_table.half_life = seconds
+
     def entropy(self):
         """
         computes to total uncertainty in the network summing the entropy of all channels
         """
-        return sum(channel.entropy() for src, dest, channel in self.network.edges(data="channel"))
+        return self._channel_table.entropy()
 
     def allocate_amount_on_path(self, path: List[UncertaintyChannel], amt: int):
         """
@@ -48,12 +176,19 @@ class UncertaintyNetwork(ChannelGraph):
         for channel in path:
             channel.allocate_amount(amt)
 
+    def evaluate_attempts(self, attempts) -> AttemptSetStatistics:
+        """
+        computes the joint success probability, the expected delivered amount and the fee of a set of
+        `Attempts` over the channels they share without changing any in_flight allocation
+        (see `AttemptSetEvaluator`)
+        """
+        return AttemptSetEvaluator(self._channel_table).evaluate(attempts)
+
     def reset_uncertainty_network(self):
         """
         resets our belief about the liquidity & inflight information of all channels on the UncertaintyNetwork
         """
-        for src, dest, channel in self.network.edges(data="channel"):
-            channel.forget_information()
+        self._channel_table.forget_information()
 
     def activate_network_wide_uncertainty_reduction(self, n, oracle: OracleLightningNetwork):
         """
@@ -61,10 +196,22 @@ class UncertaintyNetwork(ChannelGraph):
 
         While one can do this on mainnet by probing we can do this very quickly in simulation
         at virtually no cost. Thus, this API call needs to be taken with caution when using a different
-        oracle. 
+        oracle.
+
+        The binary search runs for all channels at once on the `channel_table` (see
+        `ChannelTable.learn_n_bits`) and yields the same belief as `UncertaintyChannel.learn_n_bits`.
         """
-        for src, dest, channel in self.network.edges(data="channel"):
-            channel.learn_n_bits(oracle, n)
+        if n <= 0:
+            return
+        rows, actual_liquidity = [], []
+        removed = self._channel_table.removed
+        for row, channel in enumerate(self._channels):
+            oracle_channel = oracle.get_channel_by_id(channel.short_channel_id, channel.direction)
+            # channels that were announced via gossip might be unknown to the oracle
+            if oracle_channel is not None and not removed[row]:
+                rows.append(row)
+                actual_liquidity.append(oracle_channel.actual_liquidity)
+        self._channel_table.learn_n_bits(actual_liquidity, n, np.array(rows, dtype=np.int64))
 
     # FIXME: refactor to new code base. The following call will break!
     def activate_foaf_uncertainty_reduction(self, src, dest):
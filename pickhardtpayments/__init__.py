@@ -4,7 +4,15 @@ from .OracleChannel import OracleChannel
 from .UncertaintyNetwork import UncertaintyNetwork
 from .OracleLightningNetwork import OracleLightningNetwork
 from .ChannelGraph import ChannelGraph
+from .FlowDecomposition import FlowDecomposition, DecompositionPolicy
 from .SyncSimulatedPaymentSession import SyncSimulatedPaymentSession
+from .AsyncPaymentSession import AsyncPaymentSession, OracleBackend
+from .Snapshot import Snapshot, save_snapshot
+from .Simulation import Simulation, experiment_grid
+from .Metrics import MetricsSink, InMemoryMetrics
+from .Gossip import GossipEvent, GossipEventType
+from .AttemptSetEvaluator import AttemptSetEvaluator, AttemptSetStatistics
+from .PlanCache import PlanCache, CachedPlan
 
 __version__ = "0.0.2"
 
@@ -16,5 +24,21 @@ __all__ = [
     "UncertaintyNetwork",
     "OracleLightningNetwork",
     "ChannelGraph",
-    "SyncSimulatedPaymentSession"
+    "FlowDecomposition",
+    "DecompositionPolicy",
+    "SyncSimulatedPaymentSession",
+    "AsyncPaymentSession",
+    "OracleBackend",
+    "Snapshot",
+    "save_snapshot",
+    "Simulation",
+    "experiment_grid",
+    "MetricsSink",
+    "InMemoryMetrics",
+    "GossipEvent",
+    "GossipEventType",
+    "AttemptSetEvaluator",
+    "AttemptSetStatistics",
+    "PlanCache",
+    "CachedPlan"
 ]
\ No newline at end of file
@@ -0,0 +1,384 @@
+/*
+ * _channel_math.cpp
+ * ====================================
+ * Optional compiled kernels of `ChannelMath` for the math of the `UncertaintyChannel` over arrays of rows
+ * of a `ChannelTable`.
+ *
+ * The module only depends on the Python C API. Arrays are exchanged through the buffer protocol, so any
+ * contiguous numpy array of the right dtype is accepted without a copy: the columns of the table and the
+ * rows are int64, probabilities and costs float64 and flags bool. The results are written to arrays that
+ * the caller allocates. `ChannelMath` takes care of the dtypes and falls back to its numpy implementation
+ * if the module is not built, so every function here has to agree exactly with the python reference.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+/*
+ * a contiguous buffer of `T` that is released when it goes out of scope
+ */
+template <typename T>
+class Array {
+public:
+    Array() = default;
+    Array(const Array&) = delete;
+    Array& operator=(const Array&) = delete;
+
+    ~Array() {
+        if (acquired_) {
+            PyBuffer_Release(&view_);
+        }
+    }
+
+    bool acquire(PyObject* object, const char* name, bool writable = false) {
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | (writable ? PyBUF_WRITABLE : 0);
+        if (PyObject_GetBuffer(object, &view_, flags) != 0) {
+            PyErr_Format(PyExc_TypeError, "%s must be a contiguous%s array", name, writable ? " writable" : "");
+            return false;
+        }
+        acquired_ = true;
+        if (view_.itemsize != static_cast<Py_ssize_t>(sizeof(T)) || view_.ndim > 1 || !matches(view_.format)) {
+            PyErr_Format(PyExc_TypeError, "%s has an unexpected dtype (format %s)", name,
+                         view_.format == nullptr ? "B" : view_.format);
+            return false;
+        }
+        return true;
+    }
+
+    Py_ssize_t size() const { return view_.len / static_cast<Py_ssize_t>(sizeof(T)); }
+    T* data() const { return static_cast<T*>(view_.buf); }
+    T& operator[](Py_ssize_t i) const { return data()[i]; }
+
+private:
+    static bool matches(const char* format);
+
+    Py_buffer view_{};
+    bool acquired_ = false;
+};
+
+template <>
+bool Array<int64_t>::matches(const char* format) {
+    char code = format == nullptr ? 'B' : format[format[0] == '=' || format[0] == '<' || format[0] == '@'];
+    return code == 'q' || code == 'l';
+}
+
+template <>
+bool Array<double>::matches(const char* format) {
+    char code = format == nullptr ? 'B' : format[format[0] == '=' || format[0] == '<' || format[0] == '@'];
+    return code == 'd';
+}
+
+template <>
+bool Array<bool>::matches(const char* format) {
+    char code = format == nullptr ? 'B' : format[format[0] == '=' || format[0] == '<' || format[0] == '@'];
+    return code == '?';
+}
+
+bool check_rows(const Array<int64_t>& rows, Py_ssize_t number_of_rows) {
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        if (rows[i] < 0 || rows[i] >= number_of_rows) {
+            PyErr_Format(PyExc_IndexError, "row %lld is out of bounds for %zd rows",
+                         static_cast<long long>(rows[i]), number_of_rows);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool check_length(Py_ssize_t length, Py_ssize_t expected, const char* name) {
+    if (length != expected) {
+        PyErr_Format(PyExc_ValueError, "%s has %zd entries instead of %zd", name, length, expected);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * the belief of a table: min_liquidity, max_liquidity and in_flight over the same rows
+ */
+struct Belief {
+    Array<int64_t> min_liquidity;
+    Array<int64_t> max_liquidity;
+    Array<int64_t> in_flight;
+
+    bool acquire(PyObject* min_object, PyObject* max_object, PyObject* in_flight_object, bool writable = false) {
+        return min_liquidity.acquire(min_object, "min_liquidity", writable) &&
+               max_liquidity.acquire(max_object, "max_liquidity", writable) &&
+               in_flight.acquire(in_flight_object, "in_flight") &&
+               check_length(max_liquidity.size(), min_liquidity.size(), "max_liquidity") &&
+               check_length(in_flight.size(), min_liquidity.size(), "in_flight");
+    }
+
+    Py_ssize_t size() const { return min_liquidity.size(); }
+
+    // `UncertaintyChannel.conditional_capacity`
+    int64_t conditional_capacity(int64_t row) const {
+        int64_t lower = min_liquidity[row] > in_flight[row] ? min_liquidity[row] : in_flight[row];
+        return max_liquidity[row] > lower ? max_liquidity[row] - lower : 0;
+    }
+
+    // `UncertaintyChannel.success_probability` of holding `tested` sats in total
+    double success_probability(int64_t row, int64_t tested) const {
+        int64_t lower = min_liquidity[row];
+        int64_t upper = max_liquidity[row];
+        if (tested <= lower) {
+            return 1.;
+        }
+        if (tested >= upper) {
+            return 0.;
+        }
+        int64_t conditional_amount = tested - lower;
+        int64_t conditional_capacity = upper - lower;
+        if (conditional_amount > conditional_capacity) {
+            return 0.;
+        }
+        return static_cast<double>(conditional_capacity + 1 - conditional_amount) /
+               static_cast<double>(conditional_capacity + 1);
+    }
+};
+
+// `UncertaintyChannel.routing_cost_msat`
+int64_t routing_cost_msat(int64_t ppm, int64_t base_fee, int64_t amount) {
+    return static_cast<int64_t>(static_cast<double>(ppm * amount) / 1000.) + base_fee;
+}
+
+PyObject* entropy(PyObject*, PyObject* args) {
+    PyObject *min_object, *max_object, *in_flight_object, *rows_object;
+    if (!PyArg_ParseTuple(args, "OOOO", &min_object, &max_object, &in_flight_object, &rows_object)) {
+        return nullptr;
+    }
+    Belief belief;
+    if (!belief.acquire(min_object, max_object, in_flight_object)) {
+        return nullptr;
+    }
+    double total = 0.;
+    if (rows_object == Py_None) {
+        for (Py_ssize_t row = 0; row < belief.size(); ++row) {
+            total += std::log2(static_cast<double>(belief.conditional_capacity(row) + 1));
+        }
+    } else {
+        Array<int64_t> rows;
+        if (!rows.acquire(rows_object, "rows") || !check_rows(rows, belief.size())) {
+            return nullptr;
+        }
+        for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+            total += std::log2(static_cast<double>(belief.conditional_capacity(rows[i]) + 1));
+        }
+    }
+    return PyFloat_FromDouble(total);
+}
+
+/*
+ * parses belief, rows, amounts and the output array shared by the per row kernels
+ */
+template <typename Out>
+bool parse_per_row(PyObject* args, Belief& belief, Array<int64_t>& rows, Array<int64_t>& amounts, Array<Out>& out) {
+    PyObject *min_object, *max_object, *in_flight_object, *rows_object, *amounts_object, *out_object;
+    if (!PyArg_ParseTuple(args, "OOOOOO", &min_object, &max_object, &in_flight_object, &rows_object,
+                          &amounts_object, &out_object)) {
+        return false;
+    }
+    return belief.acquire(min_object, max_object, in_flight_object) && rows.acquire(rows_object, "rows") &&
+           amounts.acquire(amounts_object, "amounts") && out.acquire(out_object, "out", true) &&
+           check_rows(rows, belief.size()) && check_length(amounts.size(), rows.size(), "amounts") &&
+           check_length(out.size(), rows.size(), "out");
+}
+
+PyObject* success_probabilities(PyObject*, PyObject* args) {
+    Belief belief;
+    Array<int64_t> rows, amounts;
+    Array<double> out;
+    if (!parse_per_row(args, belief, rows, amounts, out)) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        out[i] = belief.success_probability(rows[i], amounts[i] + belief.in_flight[rows[i]]);
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* uncertainty_costs(PyObject*, PyObject* args) {
+    Belief belief;
+    Array<int64_t> rows, amounts;
+    Array<double> out;
+    if (!parse_per_row(args, belief, rows, amounts, out)) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        double probability = belief.success_probability(rows[i], amounts[i] + belief.in_flight[rows[i]]);
+        out[i] = probability > 0. ? -std::log2(probability) : std::numeric_limits<double>::infinity();
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* linearized_integer_uncertainty_unit_costs(PyObject*, PyObject* args) {
+    PyObject *min_object, *max_object, *in_flight_object, *rows_object, *out_object;
+    long long max_channel_size;
+    if (!PyArg_ParseTuple(args, "OOOOLO", &min_object, &max_object, &in_flight_object, &rows_object,
+                          &max_channel_size, &out_object)) {
+        return nullptr;
+    }
+    Belief belief;
+    Array<int64_t> rows, out;
+    if (!belief.acquire(min_object, max_object, in_flight_object) || !rows.acquire(rows_object, "rows") ||
+        !out.acquire(out_object, "out", true) || !check_rows(rows, belief.size()) ||
+        !check_length(out.size(), rows.size(), "out")) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        int64_t conditional_capacity = belief.conditional_capacity(rows[i]);
+        out[i] = conditional_capacity > 0 ? static_cast<int64_t>(static_cast<double>(max_channel_size) /
+                                                                 static_cast<double>(conditional_capacity)) : 0;
+    }
+    Py_RETURN_NONE;
+}
+
+PyObject* routing_costs_msat(PyObject*, PyObject* args) {
+    PyObject *ppm_object, *base_fee_object, *rows_object, *amounts_object, *out_object;
+    if (!PyArg_ParseTuple(args, "OOOOO", &ppm_object, &base_fee_object, &rows_object, &amounts_object,
+                          &out_object)) {
+        return nullptr;
+    }
+    Array<int64_t> ppm, base_fee, rows, amounts, out;
+    if (!ppm.acquire(ppm_object, "ppm") || !base_fee.acquire(base_fee_object, "base_fee") ||
+        !rows.acquire(rows_object, "rows") || !amounts.acquire(amounts_object, "amounts") ||
+        !out.acquire(out_object, "out", true) || !check_length(base_fee.size(), ppm.size(), "base_fee") ||
+        !check_rows(rows, ppm.size()) || !check_length(amounts.size(), rows.size(), "amounts") ||
+        !check_length(out.size(), rows.size(), "out")) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        out[i] = routing_cost_msat(ppm[rows[i]], base_fee[rows[i]], amounts[i]);
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * the routing fee and the success probability of sending `amount` along the rows of a path as computed by
+ * `Attempt` which allocates the amount hop by hop (a channel that occurs twice has to hold it twice)
+ */
+PyObject* score_path(PyObject*, PyObject* args) {
+    PyObject *min_object, *max_object, *in_flight_object, *ppm_object, *base_fee_object, *rows_object;
+    long long amount;
+    if (!PyArg_ParseTuple(args, "OOOOOOL", &min_object, &max_object, &in_flight_object, &ppm_object,
+                          &base_fee_object, &rows_object, &amount)) {
+        return nullptr;
+    }
+    Belief belief;
+    Array<int64_t> ppm, base_fee, rows;
+    if (!belief.acquire(min_object, max_object, in_flight_object) || !ppm.acquire(ppm_object, "ppm") ||
+        !base_fee.acquire(base_fee_object, "base_fee") || !rows.acquire(rows_object, "rows") ||
+        !check_length(ppm.size(), belief.size(), "ppm") || !check_length(base_fee.size(), belief.size(), "base_fee") ||
+        !check_rows(rows, belief.size())) {
+        return nullptr;
+    }
+    long long fee = 0;
+    double probability = 1.;
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        int64_t row = rows[i];
+        int64_t allocated = amount;
+        for (Py_ssize_t j = 0; j < i; ++j) {
+            if (rows[j] == row) {
+                allocated += amount;
+            }
+        }
+        fee += routing_cost_msat(ppm[row], base_fee[row], amount);
+        probability *= belief.success_probability(row, belief.in_flight[row] + allocated);
+    }
+    return Py_BuildValue("Ld", fee, probability);
+}
+
+/*
+ * `UncertaintyChannel.update_knowledge` for every hop in order: the lower bound of the liquidity of a row
+ * rises to its in_flight amount plus the probed amount if the probe succeeded, otherwise the upper bound
+ * drops to it
+ */
+PyObject* update_knowledge(PyObject*, PyObject* args) {
+    PyObject *min_object, *max_object, *in_flight_object, *rows_object, *amounts_object, *success_object;
+    if (!PyArg_ParseTuple(args, "OOOOOO", &min_object, &max_object, &in_flight_object, &rows_object,
+                          &amounts_object, &success_object)) {
+        return nullptr;
+    }
+    Belief belief;
+    Array<int64_t> rows, amounts;
+    Array<bool> success;
+    if (!belief.acquire(min_object, max_object, in_flight_object, true) || !rows.acquire(rows_object, "rows") ||
+        !amounts.acquire(amounts_object, "amounts") || !success.acquire(success_object, "success") ||
+        !check_rows(rows, belief.size()) || !check_length(amounts.size(), rows.size(), "amounts") ||
+        !check_length(success.size(), rows.size(), "success")) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        int64_t row = rows[i];
+        int64_t tested = belief.in_flight[row] + amounts[i];
+        if (success[i]) {
+            if (tested > belief.min_liquidity[row]) {
+                belief.min_liquidity[row] = tested;
+            }
+        } else if (tested < belief.max_liquidity[row]) {
+            belief.max_liquidity[row] = tested;
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+/*
+ * the index of the first hop whose oracle channel cannot forward its in_flight amount plus `amount` as
+ * `OracleLightningNetwork.send_onion` probes them, -1 if the onion arrives
+ */
+PyObject* probe_path(PyObject*, PyObject* args) {
+    PyObject *actual_object, *oracle_rows_object, *in_flight_object, *rows_object;
+    long long amount;
+    if (!PyArg_ParseTuple(args, "OOOOL", &actual_object, &oracle_rows_object, &in_flight_object, &rows_object,
+                          &amount)) {
+        return nullptr;
+    }
+    Array<int64_t> actual_liquidity, oracle_rows, in_flight, rows;
+    if (!actual_liquidity.acquire(actual_object, "actual_liquidity") ||
+        !oracle_rows.acquire(oracle_rows_object, "oracle_rows") || !in_flight.acquire(in_flight_object, "in_flight") ||
+        !rows.acquire(rows_object, "rows") || !check_rows(oracle_rows, actual_liquidity.size()) ||
+        !check_rows(rows, in_flight.size()) || !check_length(oracle_rows.size(), rows.size(), "oracle_rows")) {
+        return nullptr;
+    }
+    for (Py_ssize_t i = 0; i < rows.size(); ++i) {
+        if (in_flight[rows[i]] + amount > actual_liquidity[oracle_rows[i]]) {
+            return PyLong_FromSsize_t(i);
+        }
+    }
+    return PyLong_FromLong(-1);
+}
+
+PyMethodDef methods[] = {
+    {"entropy", entropy, METH_VARARGS,
+     "entropy(min_liquidity, max_liquidity, in_flight, rows) -> sum of the entropy of the rows (None for all)"},
+    {"success_probabilities", success_probabilities, METH_VARARGS,
+     "success_probabilities(min_liquidity, max_liquidity, in_flight, rows, amounts, out)"},
+    {"uncertainty_costs", uncertainty_costs, METH_VARARGS,
+     "uncertainty_costs(min_liquidity, max_liquidity, in_flight, rows, amounts, out)"},
+    {"linearized_integer_uncertainty_unit_costs", linearized_integer_uncertainty_unit_costs, METH_VARARGS,
+     "linearized_integer_uncertainty_unit_costs(min_liquidity, max_liquidity, in_flight, rows, max_channel_size, out)"},
+    {"routing_costs_msat", routing_costs_msat, METH_VARARGS,
+     "routing_costs_msat(ppm, base_fee, rows, amounts, out)"},
+    {"score_path", score_path, METH_VARARGS,
+     "score_path(min_liquidity, max_liquidity, in_flight, ppm, base_fee, rows, amount) -> (fee, probability)"},
+    {"update_knowledge", update_knowledge, METH_VARARGS,
+     "update_knowledge(min_liquidity, max_liquidity, in_flight, rows, amounts, success)"},
+    {"probe_path", probe_path, METH_VARARGS,
+     "probe_path(actual_liquidity, oracle_rows, in_flight, rows, amount) -> index of the failing hop or -1"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyModuleDef module = {PyModuleDef_HEAD_INIT, "_channel_math",
+                      "compiled kernels of ChannelMath for the math of uncertainty channels", -1, methods,
+                      nullptr, nullptr, nullptr, nullptr};
+
+}  // namespace
+
+PyMODINIT_FUNC PyInit__channel_math(void) {
+    return PyModule_Create(&module);
+}
@@ -1,10 +1,20 @@
 import setuptools
+import sys
 #import os
 
 from pathlib import Path
 this_directory = Path(__file__).parent
 long_description = (this_directory / "readme.md").read_text()
 
+# the compiled kernels of ChannelMath are optional, without a C++ compiler the numpy fallback is used
+channel_math = setuptools.Extension(
+    "_channel_math",
+    sources=["pickhardtpayments/_channel_math.cpp"],
+    language="c++",
+    extra_compile_args=["-O3", "-std=c++11"] if sys.platform != "win32" else ["/O2"],
+    optional=True,
+)
+
 setuptools.setup(
     name="pickhardtpayments",
     version="0.0.0",
@@ -22,5 +32,6 @@ setuptools.setup(
     python_requires='>=3.6',
     # py_modules=["pickhardtpayments"],
     package_dir={'': 'pickhardtpayments'},
-    install_requires=["networkx", "ortools"]
+    ext_modules=[channel_math],
+    install_requires=["networkx", "numpy", "ortools"]
 )
@@ -0,0 +1,99 @@
+import importlib
+import json
+import os
+import sys
+import tempfile
+import unittest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.ChannelGraph import ChannelGraph, CHANNEL_FIELDS
+
+# the package exports the class under the name of its module
+channel_graph_module = importlib.import_module("pickhardtpayments.ChannelGraph")
+
+NODES = ["02" + str(i) * 64 for i in range(3)]
+
+
+def listchannels(number_of_channels: int):
+    """
+    a lightning-cli listchannels dump with fields that the parser has to drop, nested values and strings
+    that contain brackets and commas
+    """
+    channels = []
+    for i in range(number_of_channels):
+        src, dest = NODES[i % 3], NODES[(i + 1) % 3]
+        channels.append({"source": src, "destination": dest, "short_channel_id": "{}x{}x0".format(700_000 + i, i),
+                         "public": True, "satoshis": 1_000_000 + i, "amount_msat": "{}msat".format(1_000_000_000 + i),
+                         "message_flags": 1, "channel_flags": i % 2, "active": i % 5 != 0,
+                         "last_update": 1_650_000_000 + i, "base_fee_millisatoshi": i % 3,
+                         "fee_per_millionth": 10 * i, "delay": 40, "htlc_minimum_msat": "0msat",
+                         "htlc_maximum_msat": "990000000msat", "features": "", "alias": "[node, {}]".format(i),
+                         "extra": {"nested": [1, {"x": "]}"}]}})
+    return {"channels": channels}
+
+
+class StreamingParserTest(unittest.TestCase):
+
+    def setUp(self):
+        self.directory = tempfile.TemporaryDirectory()
+        self.read_chunk_size = channel_graph_module.READ_CHUNK_SIZE
+
+    def tearDown(self):
+        channel_graph_module.READ_CHUNK_SIZE = self.read_chunk_size
+        self.directory.cleanup()
+
+    def dump(self, content: str):
+        filename = os.path.join(self.directory.name, "listchannels.json")
+        with open(filename, "w") as f:
+            f.write(content)
+        return filename
+
+    def parse(self, filename: str):
+        return list(ChannelGraph.__new__(ChannelGraph)._get_channel_json(filename))
+
+    def expected(self, filename: str):
+        with open(filename) as f:
+            channels = json.load(f)["channels"]
+        return [{field: channel[field] for field in CHANNEL_FIELDS if field in channel} for channel in channels]
+
+    def test_parser_matches_json_load_for_every_chunk_size(self):
+        filename = self.dump(json.dumps(listchannels(25), indent=2))
+        expected = self.expected(filename)
+        # chunks that split every record, chunks of a few records and the whole file at once
+        for chunk_size in [1, 7, 64, 1000, 1 << 20]:
+            channel_graph_module.READ_CHUNK_SIZE = chunk_size
+            self.assertEqual(self.parse(filename), expected)
+
+    def test_parser_accepts_compact_and_empty_dumps(self):
+        for content in [json.dumps(listchannels(4), separators=(",", ":")), '{"channels": []}',
+                        '{"channels" : [ ]\n}']:
+            filename = self.dump(content)
+            channel_graph_module.READ_CHUNK_SIZE = 5
+            self.assertEqual(self.parse(filename), self.expected(filename))
+
+    def test_parser_rejects_a_file_without_channels(self):
+        with self.assertRaises(ValueError):
+            self.parse(self.dump('{"nodes": []}'))
+
+    def test_parser_rejects_a_malformed_channel_without_reading_the_rest(self):
+        channels = json.dumps(listchannels(3), separators=(",", ":"))
+        malformed = channels.replace('"delay":40', '"delay":forty', 1)
+        filename = self.dump(malformed[:-2] + "," + channels[len('{"channels":['):-2] * 50 + "]}")
+        channel_graph_module.READ_CHUNK_SIZE = 16
+        with self.assertRaises(json.JSONDecodeError) as raised:
+            self.parse(filename)
+        # the error is raised as soon as the record is complete instead of at the end of the file
+        self.assertLess(len(raised.exception.doc), len(channels))
+
+    def test_parser_rejects_an_oversized_channel(self):
+        channels = listchannels(1)
+        channels["channels"][0]["alias"] = "x" * (channel_graph_module.MAX_RECORD_SIZE + 1)
+        channel_graph_module.READ_CHUNK_SIZE = 1000
+        with self.assertRaisesRegex(ValueError, "more than"):
+            self.parse(self.dump(json.dumps(channels)))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,114 @@
+import os
+import sys
+import unittest
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments import ChannelMath
+from pickhardtpayments.Channel import Channel
+from pickhardtpayments.ChannelTable import ChannelTable
+from pickhardtpayments.UncertaintyChannel import UncertaintyChannel
+
+# capacity, base fee, ppm, min_liquidity, max_liquidity and in_flight of every channel
+BELIEFS = [(1_000_000, 0, 100, 0, 1_000_000, 0), (2_000_000, 1_000, 1, 500_000, 1_500_000, 0),
+           (3_000_000, 0, 2_500, 1_000_000, 1_000_000, 200_000), (500_000, 10, 0, 0, 400_000, 100_000),
+           (7, 0, 5_000, 2, 7, 1), (100_000_000, 1, 42, 10_000_000, 90_000_000, 30_000_000)]
+AMOUNTS = [0, 1, 100_000, 250_000, 1_000_000]
+
+
+def channel_table():
+    """
+    a `ChannelTable` with the `BELIEFS` and the `UncertaintyChannels` of its rows
+    """
+    channels = [Channel({"source": "02" + "0" * 64, "destination": "02" + "1" * 64,
+                         "short_channel_id": "1x{}x0".format(i), "satoshis": capacity,
+                         "base_fee_millisatoshi": base_fee, "fee_per_millionth": ppm, "delay": 40,
+                         "htlc_minimum_msat": "0msat", "htlc_maximum_msat": "{}msat".format(capacity * 1000),
+                         "active": True, "public": True})
+                for i, (capacity, base_fee, ppm, _, _, _) in enumerate(BELIEFS)]
+    table = ChannelTable(channels)
+    for row, (_, _, _, min_liquidity, max_liquidity, in_flight) in enumerate(BELIEFS):
+        table.min_liquidity[row] = min_liquidity
+        table.max_liquidity[row] = max_liquidity
+        table.in_flight[row] = in_flight
+    return table, [UncertaintyChannel(channel, table, row) for row, channel in enumerate(channels)]
+
+
+class ChannelMathTest(unittest.TestCase):
+    """
+    runs every test against the numpy fallback and, if it is built, against the `_channel_math` extension
+    """
+
+    def setUp(self):
+        self.native = ChannelMath.native_enabled()
+        self.table, self.channels = channel_table()
+        self.rows = np.arange(len(self.channels))
+
+    def tearDown(self):
+        ChannelMath.use_native(self.native)
+
+    def backends(self):
+        return [False, True] if ChannelMath.NATIVE_AVAILABLE else [False]
+
+    def columns(self):
+        return self.table.min_liquidity, self.table.max_liquidity, self.table.in_flight
+
+    def test_kernels_match_the_scalar_reference(self):
+        for native in self.backends():
+            ChannelMath.use_native(native)
+            self.assertAlmostEqual(ChannelMath.entropy(*self.columns()),
+                                   sum(channel.entropy() for channel in self.channels))
+            for amount in AMOUNTS:
+                probabilities = ChannelMath.success_probabilities(*self.columns(), self.rows, amount)
+                self.assertEqual(probabilities.tolist(),
+                                 [channel.success_probability(amount) for channel in self.channels])
+                fees = ChannelMath.routing_costs_msat(self.table.ppm, self.table.base_fee, self.rows, amount)
+                self.assertEqual(fees.tolist(), [channel.routing_cost_msat(amount) for channel in self.channels])
+            unit_costs = ChannelMath.linearized_integer_uncertainty_unit_costs(*self.columns(), self.rows)
+            for row, channel in enumerate(self.channels):
+                expected = channel.linearized_integer_uncertainty_unit_cost() if channel.conditional_capacity else 0
+                self.assertEqual(int(unit_costs[row]), expected)
+
+    def test_native_kernels_match_the_fallback(self):
+        if not ChannelMath.NATIVE_AVAILABLE:
+            self.skipTest("the _channel_math extension is not built")
+        path = [0, 3, 5, 3]
+        success = np.array([True, False, True, False, True, False])
+        actual_liquidity = np.array([600_000, 1_200_000, 2_000_000, 100_000, 5, 50_000_000], dtype=np.int64)
+        results = []
+        for native in [False, True]:
+            ChannelMath.use_native(native)
+            min_liquidity, max_liquidity, in_flight = [column.copy() for column in self.columns()]
+            result = [ChannelMath.entropy(min_liquidity, max_liquidity, in_flight, self.rows[1:])]
+            for amount in AMOUNTS:
+                result.append(ChannelMath.success_probabilities(min_liquidity, max_liquidity, in_flight, self.rows,
+                                                                amount).tolist())
+                result.append(ChannelMath.uncertainty_costs(min_liquidity, max_liquidity, in_flight, self.rows,
+                                                            amount).tolist())
+                result.append(ChannelMath.routing_costs_msat(self.table.ppm, self.table.base_fee, self.rows,
+                                                             amount).tolist())
+                result.append(ChannelMath.score_path(min_liquidity, max_liquidity, in_flight, self.table.ppm,
+                                                     self.table.base_fee, path, amount))
+                result.append(ChannelMath.probe_path(actual_liquidity, self.rows, in_flight, path, amount))
+            result.append(ChannelMath.linearized_integer_uncertainty_unit_costs(min_liquidity, max_liquidity,
+                                                                                in_flight, self.rows).tolist())
+            ChannelMath.update_knowledge(min_liquidity, max_liquidity, in_flight, self.rows, 300_000, success)
+            result.append((min_liquidity.tolist(), max_liquidity.tolist()))
+            results.append(result)
+        fallback, native = results
+        self.assertEqual(len(fallback), len(native))
+        for expected, actual in zip(fallback, native):
+            if isinstance(expected, float):
+                self.assertAlmostEqual(actual, expected)
+            elif isinstance(expected, tuple) and isinstance(expected[1], float):
+                self.assertEqual(actual[0], expected[0])
+                self.assertAlmostEqual(actual[1], expected[1])
+            else:
+                self.assertEqual(actual, expected)
+
+
+if __name__ == "__main__":
+    unittest.main()
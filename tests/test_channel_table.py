@@ -0,0 +1,73 @@
+import os
+import sys
+import unittest
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.Channel import Channel
+from pickhardtpayments.ChannelGraph import ChannelGraph
+from pickhardtpayments.UncertaintyNetwork import UncertaintyNetwork
+from pickhardtpayments.OracleLightningNetwork import OracleLightningNetwork
+
+NODES = ["02" + str(i) * 64 for i in range(4)]
+# capacity and the actual liquidity of the direction from the smaller to the larger node of every channel
+CHANNELS = [(0, 1, 1_000_000, 0), (1, 2, 1_000_000, 1_000_000), (2, 3, 3_000_000, 1_234_567), (0, 2, 7, 3),
+            (1, 3, 2_500_000, 999_999), (0, 3, 100_000_000, 61_803_398)]
+
+
+def channel(src: int, dest: int, short_channel_id: str, capacity: int):
+    return Channel({"source": NODES[src], "destination": NODES[dest], "short_channel_id": short_channel_id,
+                    "satoshis": capacity, "base_fee_millisatoshi": 0, "fee_per_millionth": 100, "delay": 40,
+                    "htlc_minimum_msat": "0msat", "htlc_maximum_msat": "{}msat".format(capacity * 1000),
+                    "active": True, "public": True})
+
+
+def channel_graph():
+    channels = []
+    for i, (src, dest, capacity, _) in enumerate(CHANNELS):
+        channels.append(channel(src, dest, "1x{}x0".format(i), capacity))
+        channels.append(channel(dest, src, "1x{}x0".format(i), capacity))
+    return ChannelGraph.from_channels(channels)
+
+
+class LearnNBitsTest(unittest.TestCase):
+
+    def setUp(self):
+        self.channel_graph = channel_graph()
+        self.oracle = OracleLightningNetwork(self.channel_graph)
+        for oracle_channel in self.oracle.channels:
+            src, dest, capacity, liquidity = CHANNELS[int(oracle_channel.short_channel_id.split("x")[1])]
+            forward = NODES[src] == oracle_channel.src
+            oracle_channel.actual_liquidity = liquidity if forward else capacity - liquidity
+
+    def beliefs(self, uncertainty_network: UncertaintyNetwork):
+        channel_table = uncertainty_network.channel_table
+        return channel_table.min_liquidity.tolist(), channel_table.max_liquidity.tolist()
+
+    def test_vectorized_binary_search_matches_the_scalar_reference(self):
+        for n in [1, 2, 5, 30]:
+            vectorized = UncertaintyNetwork(self.channel_graph)
+            vectorized.activate_network_wide_uncertainty_reduction(n, self.oracle)
+            scalar = UncertaintyNetwork(self.channel_graph)
+            for uncertainty_channel in scalar.channels:
+                uncertainty_channel.learn_n_bits(self.oracle, n)
+            self.assertEqual(self.beliefs(vectorized), self.beliefs(scalar))
+
+    def test_binary_search_starts_from_the_current_belief_and_in_flight(self):
+        vectorized = UncertaintyNetwork(self.channel_graph)
+        scalar = UncertaintyNetwork(self.channel_graph)
+        for uncertainty_network in [vectorized, scalar]:
+            channel_table = uncertainty_network.channel_table
+            channel_table.min_liquidity[:] = channel_table.capacity // 4
+            channel_table.in_flight[:] = channel_table.capacity // 8
+        vectorized.activate_network_wide_uncertainty_reduction(3, self.oracle)
+        for uncertainty_channel in scalar.channels:
+            uncertainty_channel.learn_n_bits(self.oracle, 3)
+        self.assertEqual(self.beliefs(vectorized), self.beliefs(scalar))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,106 @@
+import os
+import sys
+import unittest
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.Channel import Channel
+from pickhardtpayments.ChannelTable import ChannelTable
+from pickhardtpayments.UncertaintyChannel import UncertaintyChannel
+from pickhardtpayments.Linearization import piecewise_linearized_costs, adaptive_piecewise_linearized_costs, \
+    piece_ratio, DEFAULT_MAX_ERROR
+
+NUMBER_OF_PIECES = 5
+AMOUNT = 1_000_000
+
+
+def beliefs():
+    """
+    channels from nearly linear (much larger than the amount) to steep (about the size of the amount), with
+    and without certain liquidity and in_flight allocations
+    """
+    capacities = np.array([100_000_000, 20_000_000, 5_000_000, 2_000_000, 1_200_000, 1_000_000, 600_000,
+                           3_000_000, 3_000_000, 8_000_000], dtype=np.int64)
+    min_liquidity = np.array([0, 0, 0, 0, 0, 0, 0, 500_000, 1_500_000, 2_000_000], dtype=np.int64)
+    in_flight = np.array([0, 0, 0, 0, 0, 0, 0, 0, 200_000, 2_500_000], dtype=np.int64)
+    ppm = np.arange(len(capacities), dtype=np.int64) * 10
+    return min_liquidity, capacities, in_flight, ppm
+
+
+def uncertainty_channels():
+    """
+    the channels of `beliefs` as `UncertaintyChannels` whose belief lives in one shared `ChannelTable`
+    """
+    min_liquidity, capacities, in_flight, ppm = beliefs()
+    channels = [Channel({"source": "02" + "0" * 64, "destination": "02" + "1" * 64,
+                         "short_channel_id": "1x{}x0".format(i), "satoshis": capacity, "base_fee_millisatoshi": 0,
+                         "fee_per_millionth": fee, "delay": 40, "htlc_minimum_msat": "0msat",
+                         "htlc_maximum_msat": "{}msat".format(capacity * 1000), "active": True, "public": True})
+                for i, (capacity, fee) in enumerate(zip(capacities.tolist(), ppm.tolist()))]
+    channel_table = ChannelTable(channels)
+    channel_table.min_liquidity[:] = min_liquidity
+    channel_table.in_flight[:] = in_flight
+    return channel_table, [UncertaintyChannel(channel, channel_table, row) for row, channel in enumerate(channels)]
+
+
+class UniformLinearizationTest(unittest.TestCase):
+
+    def test_vectorized_kernel_matches_the_scalar_reference(self):
+        channel_table, channels = uncertainty_channels()
+        rows = np.arange(len(channels))
+        for mu in [0, 1, 10]:
+            capacities, costs, used = channel_table.get_piecewise_linearized_costs(rows, NUMBER_OF_PIECES, mu)
+            for row, channel in enumerate(channels):
+                pieces = channel.get_piecewise_linearized_costs(NUMBER_OF_PIECES, mu)
+                number_of_pieces = len(pieces)
+                self.assertEqual(int(used[row]), number_of_pieces)
+                self.assertEqual(list(zip(capacities[row, :number_of_pieces].tolist(),
+                                          costs[row, :number_of_pieces].tolist())), pieces)
+                self.assertFalse(capacities[row, number_of_pieces:].any())
+
+
+class AdaptiveLinearizationTest(unittest.TestCase):
+
+    def setUp(self):
+        self.min_liquidity, self.max_liquidity, self.in_flight, self.ppm = beliefs()
+        self.capacities, self.costs, self.used = adaptive_piecewise_linearized_costs(
+            self.min_liquidity, self.max_liquidity, self.in_flight, self.ppm, 1, AMOUNT, DEFAULT_MAX_ERROR,
+            NUMBER_OF_PIECES)
+
+    def test_fewer_arcs_than_uniform(self):
+        _, _, uniform_used = piecewise_linearized_costs(self.min_liquidity, self.max_liquidity, self.in_flight,
+                                                        self.ppm, 1, NUMBER_OF_PIECES)
+        self.assertEqual(self.capacities.shape[1], NUMBER_OF_PIECES)
+        self.assertTrue((self.used <= uniform_used).all())
+        self.assertLess(int(self.used.sum()), int(uniform_used.sum()))
+        # the cost of the largest channel is almost linear up to the amount
+        self.assertEqual(int(self.used[0]), 1)
+
+    def test_pieces_bound_the_error_and_the_amount(self):
+        ratio = piece_ratio(DEFAULT_MAX_ERROR)
+        certain = np.maximum(np.minimum(self.min_liquidity - self.in_flight, AMOUNT), 0)
+        conditional_capacity = np.maximum(self.max_liquidity - np.maximum(self.min_liquidity, self.in_flight), 0)
+        for channel in range(len(self.used)):
+            used = int(self.used[channel])
+            widths = self.capacities[channel, :used].tolist()
+            self.assertLessEqual(sum(widths), AMOUNT)
+            self.assertTrue(all(width > 0 for width in widths))
+            first = 1 if certain[channel] > 0 else 0
+            support = int(conditional_capacity[channel]) + 1
+            start = 0
+            for width in widths[first:]:
+                end = start + width
+                # a piece never shrinks the remaining capacity by more than the ratio of the error bound
+                # (single satoshi pieces excepted)
+                self.assertTrue(width == 1 or (support - end) / (support - start) >= ratio)
+                start = end
+            # the uncertain unit costs increase from piece to piece
+            costs = self.costs[channel, first:used].tolist()
+            self.assertEqual(costs, sorted(costs))
+
+
+if __name__ == "__main__":
+    unittest.main()
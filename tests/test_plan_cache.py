@@ -0,0 +1,83 @@
+import os
+import sys
+import unittest
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.Channel import Channel
+from pickhardtpayments.ChannelGraph import ChannelGraph
+from pickhardtpayments.UncertaintyNetwork import UncertaintyNetwork
+from pickhardtpayments.OracleLightningNetwork import OracleLightningNetwork
+from pickhardtpayments.SyncSimulatedPaymentSession import SyncSimulatedPaymentSession
+from pickhardtpayments.PlanCache import PlanCache
+from pickhardtpayments.Metrics import InMemoryMetrics, PLAN_CACHE_HITS_TOTAL, SOLVER_SOLVE_SECONDS
+
+NODES = ["02" + str(i) * 64 for i in range(4)]
+CAPACITY = 1_000_000
+
+
+def channel(src: int, dest: int, short_channel_id: str, ppm: int):
+    return Channel({"source": NODES[src], "destination": NODES[dest], "short_channel_id": short_channel_id,
+                    "satoshis": CAPACITY, "base_fee_millisatoshi": 0, "fee_per_millionth": ppm, "delay": 40,
+                    "htlc_minimum_msat": "0msat", "htlc_maximum_msat": "{}msat".format(CAPACITY * 1000),
+                    "active": True, "public": True})
+
+
+class PlanCacheTest(unittest.TestCase):
+
+    def setUp(self):
+        # two routes from node 0 to node 3, each in both directions
+        channels = []
+        for src, dest, scid, ppm in [(0, 1, "1x1x0", 100), (1, 3, "1x2x0", 100), (0, 2, "1x3x0", 200),
+                                     (2, 3, "1x4x0", 200)]:
+            channels.append(channel(src, dest, scid, ppm))
+            channels.append(channel(dest, src, scid, ppm))
+        channel_graph = ChannelGraph.from_channels(channels)
+        self.oracle = OracleLightningNetwork(channel_graph)
+        self.uncertainty_network = UncertaintyNetwork(channel_graph)
+        self.metrics = InMemoryMetrics()
+        self.session = SyncSimulatedPaymentSession(self.oracle, self.uncertainty_network, prune_network=False,
+                                                   metrics=self.metrics, quiet=True, plan_cache=PlanCache())
+        self.reset()
+
+    def reset(self):
+        """
+        forgets what we learnt and lets every channel of the oracle forward its whole capacity
+        """
+        self.uncertainty_network.reset_uncertainty_network()
+        for oracle_channel in self.oracle.channels:
+            oracle_channel.actual_liquidity = CAPACITY if oracle_channel.src < oracle_channel.dest else 0
+
+    def solves(self):
+        histogram = self.metrics.histogram(SOLVER_SOLVE_SECONDS)
+        return 0 if histogram is None else histogram.count
+
+    def pay(self, amt: int = 200_000):
+        payment = self.session.pickhardt_pay(NODES[0], NODES[3], amt, mu=1)
+        self.assertTrue(payment.successful)
+
+    def test_identical_payment_with_unchanged_belief_skips_the_solver(self):
+        self.pay()
+        self.assertEqual(self.metrics.counter(PLAN_CACHE_HITS_TOTAL), 0)
+        solves = self.solves()
+        self.assertGreater(solves, 0)
+
+        self.reset()
+        self.pay()
+        self.assertEqual(self.metrics.counter(PLAN_CACHE_HITS_TOTAL), 1)
+        self.assertEqual(self.solves(), solves)
+
+    def test_changed_belief_solves_again(self):
+        self.pay()
+        solves = self.solves()
+        # we keep what we learnt during the first payment
+        for oracle_channel in self.oracle.channels:
+            oracle_channel.actual_liquidity = CAPACITY if oracle_channel.src < oracle_channel.dest else 0
+        self.pay()
+        self.assertEqual(self.metrics.counter(PLAN_CACHE_HITS_TOTAL), 0)
+        self.assertGreater(self.solves(), solves)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,95 @@
+import os
+import sys
+import tempfile
+import unittest
+
+import numpy as np
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path[:0] = [ROOT, os.path.join(ROOT, "pickhardtpayments")]
+
+from pickhardtpayments.Channel import Channel, ChannelFields
+from pickhardtpayments.ChannelGraph import ChannelGraph
+from pickhardtpayments.UncertaintyNetwork import UncertaintyNetwork
+from pickhardtpayments.OracleLightningNetwork import OracleLightningNetwork
+from pickhardtpayments.Snapshot import Snapshot, save_snapshot
+
+NODES = ["02" + str(i) * 64 for i in range(4)]
+BELIEF_COLUMNS = ("min_liquidity", "max_liquidity", "in_flight", "learnt_at", "learnt_min_liquidity",
+                  "learnt_max_liquidity")
+PARAMETER_COLUMNS = ("capacity", "ppm", "base_fee")
+CHANNEL_FIELDS = (ChannelFields.SRC, ChannelFields.DEST, ChannelFields.CLTV, ChannelFields.HTLC_MINIMUM_MSAT,
+                  ChannelFields.HTLC_MAXIMUM_MSAT, ChannelFields.FLAGS, ChannelFields.ANNOUNCED,
+                  ChannelFields.ACTIVE, ChannelFields.LAST_UPDATE, ChannelFields.FEATURES)
+
+
+def channel(src: int, dest: int, short_channel_id: str, capacity: int, base_fee: int, ppm: int):
+    return Channel({"source": NODES[src], "destination": NODES[dest], "short_channel_id": short_channel_id,
+                    "satoshis": capacity, "base_fee_millisatoshi": base_fee, "fee_per_millionth": ppm,
+                    "delay": 40 + ppm % 7, "htlc_minimum_msat": "{}msat".format(ppm), "channel_flags": int(src > dest),
+                    "htlc_maximum_msat": "{}msat".format(capacity * 1000), "active": ppm % 3 > 0, "public": True,
+                    "last_update": 1_650_000_000 + ppm, "features": "80" if ppm % 2 else ""})
+
+
+class SnapshotTest(unittest.TestCase):
+
+    def setUp(self):
+        channels = []
+        for i, (src, dest, capacity, base_fee, ppm) in enumerate([(0, 1, 1_000_000, 0, 100), (1, 2, 2_000_000, 0, 5),
+                                                                   (2, 3, 3_000_000, 0, 1), (0, 2, 500_000, 0, 1_000),
+                                                                   (1, 3, 4_000_000, 2_000, 10)]):
+            channels.append(channel(src, dest, "7{}x{}x1".format(i, i), capacity, base_fee, ppm))
+            channels.append(channel(dest, src, "7{}x{}x1".format(i, i), capacity, base_fee, ppm + 1))
+        self.channel_graph = ChannelGraph.from_channels(channels)
+        self.oracle = OracleLightningNetwork(self.channel_graph)
+        self.uncertainty_network = UncertaintyNetwork(self.channel_graph)
+        # learnt beliefs with timestamps and in_flight allocations on some of the rows
+        table = self.uncertainty_network.channel_table
+        self.uncertainty_network.activate_network_wide_uncertainty_reduction(3, self.oracle)
+        table.in_flight[:] = np.minimum(table.min_liquidity, 1_000) * (np.arange(len(table)) % 2)
+        self.directory = tempfile.TemporaryDirectory()
+        self.filename = os.path.join(self.directory.name, "network.snapshot")
+
+    def tearDown(self):
+        self.directory.cleanup()
+
+    @staticmethod
+    def rows_by_id(uncertainty_network: UncertaintyNetwork, rows):
+        return {(uncertainty_network.channels[row].short_channel_id, uncertainty_network.channels[row].direction): row
+                for row in rows}
+
+    def test_round_trip_preserves_every_column_and_belief(self):
+        save_snapshot(self.filename, self.uncertainty_network, self.oracle)
+        snapshot = Snapshot(self.filename)
+        table = self.uncertainty_network.channel_table
+        # the channel with a base fee is above the default threshold and not written
+        rows = np.flatnonzero(~table.removed)
+        self.assertEqual(len(snapshot), len(rows))
+        self.assertLess(len(rows), len(table))
+        self.assertTrue(snapshot.has_oracle)
+
+        loaded = snapshot.uncertainty_network()
+        loaded_table = loaded.channel_table
+        original_rows = self.rows_by_id(self.uncertainty_network, rows.tolist())
+        loaded_rows = self.rows_by_id(loaded, range(len(loaded_table)))
+        self.assertEqual(sorted(loaded_rows), sorted(original_rows))
+        for key, row in loaded_rows.items():
+            original_row = original_rows[key]
+            for column in PARAMETER_COLUMNS + BELIEF_COLUMNS:
+                self.assertEqual(getattr(loaded_table, column)[row], getattr(table, column)[original_row], column)
+            channel, original_channel = loaded.channels[row], self.uncertainty_network.channels[original_row]
+            for field in CHANNEL_FIELDS:
+                self.assertEqual(channel.cln_jsn[field], original_channel.cln_jsn[field], field)
+        self.assertAlmostEqual(loaded.entropy(), self.uncertainty_network.entropy())
+
+        oracle = snapshot.oracle_lightning_network()
+        for oracle_channel in self.oracle.channels:
+            if oracle_channel.base_fee > 0:
+                continue
+            loaded_channel = oracle.get_channel(oracle_channel.src, oracle_channel.dest,
+                                                oracle_channel.short_channel_id)
+            self.assertEqual(loaded_channel.actual_liquidity, oracle_channel.actual_liquidity)
+
+
+if __name__ == "__main__":
+    unittest.main()